@@ -4,6 +4,7 @@
 #include "Workspace.h"
 #include "MeshBrowser/MeshBrowserWidget.h"
 #include "Stacker/Controller.h"
+#include "Stacker/ProjectFile.h"
 
 QMeshDoc::QMeshDoc( QObject * parent ) : QObject(parent)
 {
@@ -22,7 +23,7 @@ void QMeshDoc::importObject()
 	if(workspace->activeScene == NULL) return;
 
 	// The dialog
-	QString fileName = QFileDialog::getOpenFileName(0, "Import Mesh", DEFAULT_FILE_PATH, "Mesh Files (*.obj *.off *.stl)"); 
+	QString fileName = QFileDialog::getOpenFileName(0, "Import Mesh", DEFAULT_FILE_PATH, "Mesh Files (*.obj *.off *.stl *.stk)"); 
 	
 	// Read the file
 	QSegMesh * newMesh = importObject(fileName);
@@ -58,6 +59,27 @@ QSegMesh * QMeshDoc::importObject(QString fileName)
 	QSegMesh * newMesh = new QSegMesh();
 	all_objects[ newObjId ] = newMesh;
 
+	// Stacker project, mesh with its controller and groups
+	if(fInfo.suffix().toLower() == "stk")
+	{
+		ProjectFile project;
+
+		if(!project.open(fileName) || !project.readMesh(newMesh))
+		{
+			all_objects.remove(newObjId);
+			delete newMesh;
+			emit(printMessage(QString("Error: invalid project (%1).").arg(fileName)));
+			return NULL;
+		}
+
+		newMesh->setObjectName(newObjId);
+
+		Controller * ctrl = project.readController(newMesh);
+		newMesh->ptr["controller"] = ctrl ? ctrl : new Controller(newMesh);
+
+		return newMesh;
+	}
+
 	// Reading QSegMesh
 	newMesh->read(fileName);
 
@@ -114,7 +136,7 @@ void QMeshDoc::exportObject(QSegMesh * mesh)
 		return;
 	}
 
-	QString fileName = QFileDialog::getSaveFileName(0, "Export Mesh", DEFAULT_FILE_PATH, "Mesh Files (*.obj *.off *.stl)"); 
+	QString fileName = QFileDialog::getSaveFileName(0, "Export Mesh", DEFAULT_FILE_PATH, "Mesh Files (*.obj *.off *.stl);;Stacker Project (*.stk)"); 
 
 	// Based on file extension
 	QString ext = fileName.right(3).toLower();
@@ -124,6 +146,11 @@ void QMeshDoc::exportObject(QSegMesh * mesh)
 		mesh->saveObj(fileName);
 	}
 
+	if(ext == "stk")
+	{
+		ProjectFile::save(fileName, mesh, (Controller *)mesh->ptr["controller"]);
+	}
+
 	emit(printMessage(mesh->objectName() + " has been exported."));
 
 	DEFAULT_FILE_PATH = QFileInfo(fileName).absolutePath();
@@ -457,6 +457,7 @@ void Scene::mousePressEvent( QMouseEvent* e )
 						mesh->garbage_collection();
 
 						mesh->buildUp();
+						activeObject()->updateIndexTables();
 						updateActiveObject();
 						prim->computeMeshCoordinates();
 					}
@@ -1,8 +1,10 @@
 ﻿#include "GUI/global.h"
 #include "GraphicsLibrary/Mesh/QSegMesh.h"
 #include <fstream>
-#include <set>
-#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <QFile>
 #include <QTextStream>
 #include <QVector>
@@ -34,6 +36,8 @@ QSegMesh::QSegMesh( const QSegMesh& from )
 	}
 
 	this->upVec = from.upVec;
+
+	updateIndexTables();
 }
 
 QSegMesh& QSegMesh::operator=( const QSegMesh& rhs )
@@ -53,6 +57,8 @@ QSegMesh& QSegMesh::operator=( const QSegMesh& rhs )
 
 	this->upVec = rhs.upVec;
 
+	updateIndexTables();
+
 	return *this;
 }
 
@@ -133,102 +139,90 @@ void QSegMesh::read( QString fileName )
 	checkObjSegmentation(fileName, segFilename);
 
 	// Load segmentation file
-	std::ifstream inF(qPrintable(segFilename), std::ios::in);
+	int nbSeg = 0;
+	std::vector<int> faceSeg;
 
-	if (turnOffSegments || mesh.n_faces() < 1 || !inF)
+	if (turnOffSegments || mesh.n_faces() < 1 || !readSegmentation(segFilename, mesh.n_faces(), nbSeg, faceSeg) || nbSeg == 0)
 	{
-		// Unsegmented mesh
+		// Unsegmented mesh, non-segmented / point cloud?
 		segment.push_back(new QSurfaceMesh(mesh));
 	}
 	else
 	{
-		int nbSeg;
-		inF >> nbSeg;
+		int nbFaces = mesh.n_faces();
+		int nbVerts = mesh.n_vertices();
 
-		if(nbSeg == 0)
-			segment.push_back(new QSurfaceMesh(mesh)); // non-segmented / point cloud?
-		else
-		{
-			nbSeg = Max(1, nbSeg);
+		// Bucket the faces of each segment, keeping their order
+		std::vector<int> segFaceStart(nbSeg + 1, 0);
+		for (int f = 0; f < nbFaces; f++)
+			segFaceStart[faceSeg[f] + 1]++;
+		for (int i = 0; i < nbSeg; i++)
+			segFaceStart[i + 1] += segFaceStart[i];
 
-			segmentName.clear();
-			std::string str;
-			inF >> str;
-			if (str == "labels")
-			{
-				for (int i=0;i<nbSeg;i++)
-				{
-					inF >> str;
-					segmentName.push_back(str.c_str());
-				}
-			}
-			else
-			{// Fall back
-				inF.seekg(-(int)str.size(), std::ios::cur);
-			}
+		std::vector<int> segFaces(nbFaces);
+		std::vector<int> cursor(segFaceStart.begin(), segFaceStart.end() - 1);
+		for (int f = 0; f < nbFaces; f++)
+			segFaces[cursor[faceSeg[f]]++] = f;
 
-			// Assign face segments
-			std::vector<int> faceSeg(mesh.n_faces());
-			int fid, sid;
-			for (int i=0;i<(int)mesh.n_faces()&&inF;i++)
-			{
-				inF >> fid >> sid;	
-				faceSeg[fid] = sid;
-			}
-			inF.close();
+		// Create segments
+		for (int i = 0; i < nbSeg; i++)
+			segment.push_back(new QSurfaceMesh());
 
-			// Create segments
-			for (int i=0;i<nbSeg;i++)
-			{
-				segment.push_back(new QSurfaceMesh());
-			}
+		Surface_mesh::Vertex_property<Point> points = mesh.vertex_property<Point>("v:point");
 
-			// Create unique vertex set for each segment
-			std::vector< std::set <Surface_mesh::Vertex> > segVertices(nbSeg);
-			Surface_mesh::Face_iterator fit, fend = mesh.faces_end();
-			Surface_mesh::Vertex_around_face_circulator fvit;	
+		// Fill the segments in parallel, each thread with its own remapping array
+		#pragma omp parallel
+		{
+			std::vector<int> localIndex(nbVerts, -1);
+			std::vector<int> segVertices;
+			std::vector<Surface_mesh::Vertex> vertices;
 
-			for (fit = mesh.faces_begin(); fit!=fend; ++fit)
+			#pragma omp for schedule(dynamic)
+			for (int i = 0; i < nbSeg; i++)
 			{
-				Surface_mesh::Face f = fit;
-				int sid = faceSeg[f.idx()];
+				QSurfaceMesh * seg = segment[i];
+				int fbegin = segFaceStart[i], fend = segFaceStart[i + 1];
 
-				fvit = mesh.vertices(fit);	
-				segVertices[sid].insert(fvit);
-				segVertices[sid].insert(++fvit);
-				segVertices[sid].insert(++fvit);
-			}
+				// Unique vertices of the segment
+				segVertices.clear();
+				for (int j = fbegin; j < fend; j++)
+				{
+					Surface_mesh::Vertex_around_face_circulator fvit = mesh.vertices(Surface_mesh::Face(segFaces[j])), fvend = fvit;
+					do{
+						int v = Surface_mesh::Vertex(fvit).idx();
+						if (localIndex[v] < 0){
+							localIndex[v] = 0;
+							segVertices.push_back(v);
+						}
+					} while(++fvit != fvend);
+				}
 
-			// Add Vertices to each segment	
-			std::vector< std::map <Surface_mesh::Vertex, Surface_mesh::Vertex> > segVerMap(nbSeg);
-			Surface_mesh::Vertex_property<Point>  points   = mesh.vertex_property<Point>("v:point");
+				// Local vertices keep the order they had in the whole mesh
+				std::sort(segVertices.begin(), segVertices.end());
 
-			for (int i=0;i<nbSeg;i++)
-			{
-				int j = 0;
+				seg->reserve(segVertices.size(), 3 * (fend - fbegin) / 2, fend - fbegin);
 
-				std::set<Surface_mesh::Vertex>::iterator vit, vend = segVertices[i].end();
-				for (vit=segVertices[i].begin(); vit!=vend; vit++, j++)
+				for (int j = 0; j < (int)segVertices.size(); j++)
 				{
-					segment[i]->add_vertex(mesh.getVertexPos(*vit));
-
-					segVerMap[i].insert(std::make_pair(*vit, mesh.getVertex(j)));  // Create a new index for each vertex
+					localIndex[segVertices[j]] = j;
+					seg->add_vertex(points[Surface_mesh::Vertex(segVertices[j])]);
 				}
-			}
 
-			// Add Faces to each segment
-			std::vector<Surface_mesh::Vertex>  vertices(3);
-			for (fit = mesh.faces_begin(); fit!=fend; ++fit)
-			{
-				Surface_mesh::Face f = fit;
-				int sid = faceSeg[f.idx()];
+				// Add faces
+				for (int j = fbegin; j < fend; j++)
+				{
+					vertices.clear();
+					Surface_mesh::Vertex_around_face_circulator fvit = mesh.vertices(Surface_mesh::Face(segFaces[j])), fvend = fvit;
+					do{
+						vertices.push_back(Surface_mesh::Vertex(localIndex[Surface_mesh::Vertex(fvit).idx()]));
+					} while(++fvit != fvend);
 
-				fvit = mesh.vertices(fit);
-				vertices[0] = segVerMap[sid][fvit];
-				vertices[1] = segVerMap[sid][++fvit];
-				vertices[2] = segVerMap[sid][++fvit];
+					seg->add_face(vertices);
+				}
 
-				segment[sid]->add_face(vertices);
+				// Reset for the next segment of this thread
+				for (int j = 0; j < (int)segVertices.size(); j++)
+					localIndex[segVertices[j]] = -1;
 			}
 		}
 	}
@@ -246,6 +240,59 @@ void QSegMesh::read( QString fileName )
 	build_up();
 }
 
+bool QSegMesh::readSegmentation( QString segFilename, int nbFaces, int & nbSeg, std::vector<int> & faceSeg )
+{
+	QFile file(segFilename);
+	if (!file.open(QIODevice::ReadOnly)) return false;
+
+	QByteArray bytes = file.readAll();
+	file.close();
+
+	const char * p = bytes.constData();
+	char * next;
+
+	nbSeg = strtol(p, &next, 10);
+	p = next;
+	if (nbSeg == 0) return true;
+
+	nbSeg = Max(1, nbSeg);
+
+	// Optional segment names
+	while (isspace(*p)) p++;
+	if (strncmp(p, "labels", 6) == 0 && isspace(p[6]))
+	{
+		segmentName.clear();
+		p += 6;
+
+		for (int i = 0; i < nbSeg; i++)
+		{
+			while (isspace(*p)) p++;
+			const char * name = p;
+			while (*p && !isspace(*p)) p++;
+			segmentName.push_back(QString::fromAscii(name, p - name));
+		}
+	}
+
+	// Assign face segments, pairs of "fid sid"
+	faceSeg.assign(nbFaces, 0);
+
+	for (int i = 0; i < nbFaces; i++)
+	{
+		int fid = strtol(p, &next, 10);
+		if (next == p) break;
+		p = next;
+
+		int sid = strtol(p, &next, 10);
+		if (next == p) break;
+		p = next;
+
+		if (fid >= 0 && fid < nbFaces && sid >= 0 && sid < nbSeg)
+			faceSeg[fid] = sid;
+	}
+
+	return true;
+}
+
 void QSegMesh::saveObj( QString fileName )
 {
     FILE * outF = fopen (qPrintable(fileName) , "w");
@@ -280,6 +327,15 @@ void QSegMesh::saveObj( QString fileName )
 void QSegMesh::insertCopyMesh(QSurfaceMesh * newSegment)
 {
 	this->segment.push_back(new QSurfaceMesh(*newSegment));
+
+	updateIndexTables();
+}
+
+void QSegMesh::insertMesh(QSurfaceMesh * newSegment)
+{
+	this->segment.push_back(newSegment);
+
+	updateIndexTables();
 }
 
 void QSegMesh::build_up()
@@ -299,6 +355,8 @@ void QSegMesh::build_up()
 	
 	setColorVertices();
 
+	updateIndexTables();
+
 	printf("Segments loaded: %d \n", nbSegments());
 
 	isReady = true;
@@ -319,20 +377,27 @@ void QSegMesh::update_vertex_normals()
 
 void QSegMesh::computeBoundingBox()
 {
-	// compute bounding box
+	// Refresh the bounds of each segment, then reduce them
+	#pragma omp parallel for
+	for (int i = 0; i < (int)nbSegments();i++)
+		segment[i]->computeBoundingBox();
+
+	updateBoundingBox();
+}
+
+void QSegMesh::updateBoundingBox()
+{
+	// Reduce over the per-segment bounds, which are kept up to date by
+	// whoever moves the segment vertices (e.g. Primitive::deformMesh)
 	bbmin = Point( FLT_MAX,  FLT_MAX,  FLT_MAX);
 	bbmax = Point(-FLT_MAX, -FLT_MAX, -FLT_MAX);	
-	
+
 	for (int i = 0; i < (int)nbSegments();i++)
 	{
-		Surface_mesh::Vertex_property<Point> points = segment[i]->vertex_property<Point>("v:point");
-		Surface_mesh::Vertex_iterator vit, vend = segment[i]->vertices_end();
+		if(segment[i]->n_vertices() == 0) continue;
 
-		for (vit = segment[i]->vertices_begin(); vit != vend; ++vit)
-		{
-			bbmin.minimize(points[vit]);
-			bbmax.maximize(points[vit]);
-		}		
+		bbmin.minimize(segment[i]->bbmin);
+		bbmax.maximize(segment[i]->bbmax);
 	}
 	
 	center = (bbmin + bbmax) * 0.5f;
@@ -391,15 +456,18 @@ QSurfaceMesh* QSegMesh::getSegment( uint i )
 
 QSurfaceMesh* QSegMesh::getSegment( QString sid )
 {
-	for(int i = 0; i < segmentName.size(); i++)
-		if(segmentName[i] == sid)
-			return segment[i];
-	return NULL;
+	checkIndexTables();
+
+	QHash<QString, int>::const_iterator it = segmentIndex.find(sid);
+	if(it == segmentIndex.end()) return NULL;
+	return segment[it.value()];
 }
 
 void QSegMesh::setSegment(uint i, QSurfaceMesh * newSegment)
 {
 	segment[i] = newSegment;
+
+	updateIndexTables();
 }
 
 std::vector<QSurfaceMesh*> QSegMesh::getSegments()
@@ -416,12 +484,11 @@ void QSegMesh::simpleDraw( bool isColored /*= true*/, bool isDots /*= false*/ )
 
 void QSegMesh::drawFacesUnique()
 {
-	uint offset = 0;
+	// Same offsets as global2local_fid decodes with
+	checkIndexTables();
+
 	for (int i=0;i<(int)segment.size();i++)
-	{
-		segment[i]->drawFacesUnique(offset);
-		offset += segment[i]->n_faces();
-	}
+		segment[i]->drawFacesUnique(faceOffsets[i]);
 }
 
 void QSegMesh::drawDebug()
@@ -446,27 +513,50 @@ void QSegMesh::setObjectName( const QString &name )
 	{
 		segment[i]->setObjectName(segmentName[i]);
 	}
+
+	updateIndexTables();
 }
 
 uint QSegMesh::nbVertices()
 {
-	uint num = 0;
-
-	for (int i=0;i<(int)segment.size();i++)
-		num += segment[i]->n_vertices();
+	checkIndexTables();
 
-	return num;
+	return vertexOffsets.back();
 }
 
 
 uint QSegMesh::nbFaces()
 {
-	uint num = 0;
+	checkIndexTables();
 
-	for (int i=0;i<(int)segment.size();i++)
-		num += segment[i]->n_faces();
+	return faceOffsets.back();
+}
 
-	return num;
+void QSegMesh::updateIndexTables()
+{
+	int nbSeg = segment.size();
+
+	faceOffsets.assign(nbSeg + 1, 0);
+	vertexOffsets.assign(nbSeg + 1, 0);
+
+	for (int i=0;i<nbSeg;i++)
+	{
+		faceOffsets[i + 1] = faceOffsets[i] + segment[i]->n_faces();
+		vertexOffsets[i + 1] = vertexOffsets[i] + segment[i]->n_vertices();
+	}
+
+	// First segment wins on duplicate names, as with the old linear search
+	segmentIndex.clear();
+	for (int i = segmentName.size() - 1; i >= 0; i--)
+		segmentIndex[segmentName[i]] = i;
+}
+
+void QSegMesh::checkIndexTables()
+{
+	// Catch segments added or removed without going through this class. Kept O(1) since
+	// it runs on every index lookup; re-meshing a segment must call \updateIndexTables
+	if(faceOffsets.size() != segment.size() + 1)
+		updateIndexTables();
 }
 
 std::vector<uint> QSegMesh::vertexIndicesAroundFace( uint fid )
@@ -488,23 +578,9 @@ void QSegMesh::global2local_fid( uint fid, uint& sid, uint& fid_local )
 {
 	if (fid >= nbFaces()) return;
 
-	uint offset = 0;
-	int i=0;
-	for (;i<(int)segment.size();i++)
-	{
-
-
-		offset += segment[i]->n_faces();
-
-		if (fid < offset)
-		{
-			offset -= segment[i]->n_faces();
-			break;
-		}
-	}
-
-	sid = i;
-	fid_local = fid - offset;
+	// Last segment starting at or before fid, skipping empty ones
+	sid = std::upper_bound(faceOffsets.begin(), faceOffsets.end(), fid) - faceOffsets.begin() - 1;
+	fid_local = fid - faceOffsets[sid];
 }
 
 Point QSegMesh::getVertexPos( uint vid )
@@ -518,21 +594,10 @@ Point QSegMesh::getVertexPos( uint vid )
 
 void QSegMesh::global2local_vid( uint vid, uint& sid, uint& vid_local )
 {
-	uint offset = 0;
-	int i=0;
-	for (;i<(int)segment.size();i++)
-	{
-		offset += segment[i]->n_vertices();
-
-		if (vid < offset)
-		{
-			offset -= segment[i]->n_vertices();
-			break;
-		}
-	}
+	checkIndexTables();
 
-	sid = i;
-	vid_local = vid - offset;
+	sid = std::upper_bound(vertexOffsets.begin(), vertexOffsets.end(), vid) - vertexOffsets.begin() - 1;
+	vid_local = vid - vertexOffsets[sid];
 }
 
 void QSegMesh::setVertexColor( uint vid, const Color& newColor )
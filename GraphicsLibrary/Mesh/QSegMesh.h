@@ -3,6 +3,7 @@
 #include <QString>
 #include <QVector>
 #include <QMap>
+#include <QHash>
 #include "QSurfaceMesh.h"
 #include <vector>
 
@@ -33,6 +34,10 @@ public:
 	uint nbSegments();
 	uint segmentIdOfVertex( uint vid );
 
+	// Prefix sums of the segment sizes and the name lookup, call after
+	// changing the segments or the topology of any of them
+	void updateIndexTables();
+
 	// Draw
 	void simpleDraw(bool isColored = true, bool isDots = false);
 	void drawFacesUnique();
@@ -49,11 +54,13 @@ public:
 	void build_up();
 	void moveCenterToOrigin();
 	void computeBoundingBox();
+	void updateBoundingBox();	// From the cached segment bounds
 	void setColorVertices( double r = 1.0, double g = 1.0, double b = 1.0, double a = 1.0);
 	void update_face_normals();
 	void update_vertex_normals();
 	void normalize();
 	void insertCopyMesh(QSurfaceMesh * newSegment);
+	void insertMesh(QSurfaceMesh * newSegment);		// Takes ownership
 	QSurfaceMesh * flattenMesh();
 
 	// Basic rotations
@@ -84,8 +91,16 @@ public:
 
 private:
 	std::vector<QSurfaceMesh*> segment;
+
+	// Global index of the first face / vertex of each segment, plus the totals
+	std::vector<uint> faceOffsets, vertexOffsets;
+	QHash<QString, int> segmentIndex;
+	void checkIndexTables();
 	
 	// This is useful for segmented OBJs
 	void checkObjSegmentation ( QString fileName, QString segFilename);
 
+	// Number of segments and segment of each face from a .seg file
+	bool readSegmentation( QString segFilename, int nbFaces, int & nbSeg, std::vector<int> & faceSeg );
+
 };
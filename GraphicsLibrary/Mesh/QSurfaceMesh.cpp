@@ -179,25 +179,45 @@ void QSurfaceMesh::simpleDraw(bool isColored, bool isDots)
 	Vertex_property<Normal>  vnormals = vertex_property<Point>("v:normal");
 	Vertex_property<Color>  vcolors  = vertex_property<Color>("v:color");
 	Face_iterator fit, fend = faces_end();
-	Vertex_iterator vit, vend = vertices_end();
-	Vertex_around_face_circulator fvit;
-	Vertex v0, v1, v2;
 
 	// Draw faces
 	glBegin(isDots ? GL_POINTS: GL_TRIANGLES);
 
-	for(fit = faces_begin(); fit != fend; ++fit){
-		fvit = vertices(fit);
+	for(fit = faces_begin(); fit != fend; ++fit)
+		drawFace(fit, points, &vnormals, isColored ? &vcolors : NULL);
 
-		v0 = fvit; v1 = ++fvit; v2 = ++fvit;
+	glEnd();
+}
+
+// Depth only, for the faces in \faces
+void QSurfaceMesh::simpleDraw( const std::vector<uint>& faces )
+{
+	Vertex_property<Point>  points   = vertex_property<Point>("v:point");
+
+	glBegin(GL_TRIANGLES);
+
+	for(uint i = 0; i < faces.size(); i++)
+		drawFace(Face(faces[i]), points);
 
-		if(isColored)glColor4dv(vcolors[v0]);glNormal3dv(vnormals[v0]);glVertex3dv(points[v0]);
-		if(isColored)glColor4dv(vcolors[v1]);glNormal3dv(vnormals[v1]);glVertex3dv(points[v1]);
-		if(isColored)glColor4dv(vcolors[v2]);glNormal3dv(vnormals[v2]);glVertex3dv(points[v2]);
-	}
 	glEnd();
 }
 
+// First triangle of \f, with normals and colors when given
+void QSurfaceMesh::drawFace( Face f, Vertex_property<Point> & points, Vertex_property<Normal> * vnormals, Vertex_property<Color> * vcolors )
+{
+	Vertex_around_face_circulator fvit = vertices(f);
+	Vertex v[3];
+
+	v[0] = fvit; v[1] = ++fvit; v[2] = ++fvit;
+
+	for(int i = 0; i < 3; i++)
+	{
+		if(vcolors) glColor4dv((*vcolors)[v[i]]);
+		if(vnormals) glNormal3dv((*vnormals)[v[i]]);
+		glVertex3dv(points[v[i]]);
+	}
+}
+
 void QSurfaceMesh::drawFaceNames()
 {
 	// TODO:
@@ -209,8 +229,6 @@ void QSurfaceMesh::drawFacesUnique(uint offset)
 
 	Vertex_property<Point> points = vertex_property<Point>("v:point");
 	Face_iterator fit, fend = faces_end();
-	Vertex_around_face_circulator fvit, fvend;
-	Vertex v0, v1, v2;
 
 	glDisable(GL_BLEND);
 //	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -218,38 +236,62 @@ void QSurfaceMesh::drawFacesUnique(uint offset)
 	glBegin(GL_TRIANGLES);
 
 	for(fit = faces_begin(); fit != fend; ++fit)
-	{
-		uint f_id = ((Face)fit).idx() + 1 + offset;
+		drawFaceUnique(fit, offset, points);
 
-		GLubyte a = (f_id & 0xFF000000) >> 24;
-		GLubyte r = (f_id & 0x00FF0000) >> 16;
-		GLubyte g = (f_id & 0x0000FF00) >> 8;
-		GLubyte b = (f_id & 0x000000FF) >> 0;
+	glEnd();
 
-		// Magical color!
-		glColor4ub(r,g,b,255 - a);
+	glEnable(GL_LIGHTING);
+}
 
-		fvit = fvend = vertices(fit);
-		v0 = fvit;
-		v2 = ++fvit;
+void QSurfaceMesh::drawFacesUnique( uint offset, const std::vector<uint>& faces )
+{
+	glDisable(GL_LIGHTING);
 
-		do{
-			v1 = v2;
-			v2 = fvit;
+	Vertex_property<Point> points = vertex_property<Point>("v:point");
 
-			glVertex3dv(points[v0]);
-			glVertex3dv(points[v1]);
-			glVertex3dv(points[v2]);
+	glDisable(GL_BLEND);
 
-		} while (++fvit != fvend);
+	glBegin(GL_TRIANGLES);
 
-	}
+	for(uint i = 0; i < faces.size(); i++)
+		drawFaceUnique(Face(faces[i]), offset, points);
 
 	glEnd();
 
 	glEnable(GL_LIGHTING);
 }
 
+// Triangle fan of \f in the color encoding its index
+void QSurfaceMesh::drawFaceUnique( Face f, uint offset, Vertex_property<Point> & points )
+{
+	Vertex_around_face_circulator fvit, fvend;
+	Vertex v0, v1, v2;
+
+	uint f_id = f.idx() + 1 + offset;
+
+	GLubyte a = (f_id & 0xFF000000) >> 24;
+	GLubyte r = (f_id & 0x00FF0000) >> 16;
+	GLubyte g = (f_id & 0x0000FF00) >> 8;
+	GLubyte b = (f_id & 0x000000FF) >> 0;
+
+	// Magical color!
+	glColor4ub(r,g,b,255 - a);
+
+	fvit = fvend = vertices(f);
+	v0 = fvit;
+	v2 = ++fvit;
+
+	do{
+		v1 = v2;
+		v2 = fvit;
+
+		glVertex3dv(points[v0]);
+		glVertex3dv(points[v1]);
+		glVertex3dv(points[v2]);
+
+	} while (++fvit != fvend);
+}
+
 void QSurfaceMesh::moveCenterToOrigin()
 {
 	computeBoundingBox();
@@ -61,8 +61,10 @@ public:
 
 	void drawFaceNames();
 	void drawFacesUnique(uint offset);
+	void drawFacesUnique(uint offset, const std::vector<uint>& faces);
 	void drawDebug();
 	void simpleDraw(bool isColored = true, bool isDots = false);
+	void simpleDraw(const std::vector<uint>& faces);
 	void simpleDrawWireframe();
 
 	void setColorVertices(double r = 1.0, double g = 1.0, double b = 1.0, double a = 1.0);
@@ -111,4 +113,8 @@ public:
 
 private:
 	bool isDirty;
+
+	// Per-face drawing, between glBegin(GL_TRIANGLES) and glEnd()
+	void drawFace(Face f, Vertex_property<Point> & points, Vertex_property<Normal> * vnormals = NULL, Vertex_property<Color> * vcolors = NULL);
+	void drawFaceUnique(Face f, uint offset, Vertex_property<Point> & points);
 };
@@ -21,124 +21,251 @@
 
 #include "IO_.h"
 #include <stdio.h>
+#include <math.h>
 
 
 //== IMPLEMENTATION ===========================================================
 
 
-bool read_obj(Surface_mesh& mesh, const std::string& filename)
+// the file is read at once and parsed in chunks of about this many bytes
+#define OBJ_CHUNK_SIZE (1 << 20)
+
+
+// helper struct for OBJ reader: what was parsed in one chunk of the file
+struct Obj_chunk
 {
-  char   s[200];
-  float  x, y, z;
-  std::vector<Surface_mesh::Vertex>  vertices;
+  const char *begin, *end;
+  std::vector<float> points;     // x,y,z per vertex
+  std::vector<int>   indices;    // 1-based vertex indices of all faces
+  std::vector<int>   valences;   // number of indices per face
+};
 
 
-  // open file (in ASCII mode)
-  FILE* in = fopen(filename.c_str(), "r");
-  if (!in) return false;
+//-----------------------------------------------------------------------------
 
 
-  // if mesh is not empty we need an offset for vertex indices
-  // also take into accout that OBJ indices start at 1 (not 0)
-  const int voffset = mesh.n_vertices() - 1;
+static inline bool obj_is_blank(char c) { return c==' ' || c=='\t'; }
+static inline bool obj_is_eol(char c)   { return c=='\n' || c=='\r' || c=='\0'; }
+static inline bool obj_is_digit(char c) { return c>='0' && c<='9'; }
+
 
+// parse a decimal number (as sscanf's %f would), returns false if none found
+static bool obj_parse_float(const char*& p, float& f)
+{
+  // powers of ten that are exact in double precision
+  static const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+  while (obj_is_blank(*p)) ++p;
 
-  // clear line once
-  memset(&s, 0, 200);
+  bool negative = (*p == '-');
+  if (*p == '-' || *p == '+') ++p;
 
+  unsigned long long mantissa(0);
+  int digits(0), exponent(0);
+  bool any(false);
 
-  // parse line by line (currently only supports vertex positions & faces
-  while(in && !feof(in) && fgets(s, 200, in))
+  for (; obj_is_digit(*p); ++p, any=true)
   {
-    // comment
-    if (s[0] == '#' || isspace(s[0])) continue;
+    if (digits < 18) { mantissa = mantissa*10 + (*p-'0'); if (mantissa) ++digits; }
+    else ++exponent;
+  }
 
-    // vertex
-    else if (strncmp(s, "v ", 2) == 0)
+  if (*p == '.')
+  {
+    for (++p; obj_is_digit(*p); ++p, any=true)
     {
-      if (sscanf(s, "v %f %f %f", &x, &y, &z))
-      {
-        mesh.add_vertex(Point(x,y,z));
-      }
+      if (digits < 18) { mantissa = mantissa*10 + (*p-'0'); if (mantissa) ++digits; --exponent; }
     }
+  }
+
+  if (!any) return false;
 
-    // face
-    else if (strncmp(s, "f ", 2) == 0)
+  if (*p == 'e' || *p == 'E')
+  {
+    const char* q = p+1;
+    bool eneg = (*q == '-');
+    if (*q == '-' || *q == '+') ++q;
+    if (obj_is_digit(*q))
     {
-      int component(0), nV(0);
-      bool endOfVertex(false);
-      char *p0, *p1(s+1);
+      int e(0);
+      for (; obj_is_digit(*q); ++q) if (e < 10000) e = e*10 + (*q-'0');
+      exponent += eneg ? -e : e;
+      p = q;
+    }
+  }
 
-      vertices.clear();
+  // one rounding when the power of ten is exact
+  double d = (double) mantissa;
+  if      (exponent == 0)                   {}
+  else if (exponent > 0 && exponent <= 22)  d *= pow10[exponent];
+  else if (exponent < 0 && exponent >= -22) d /= pow10[-exponent];
+  else                                      d *= pow(10.0, exponent);
 
-      // skip white-spaces
-      while (*p1==' ') ++p1;
+  f = (float)(negative ? -d : d);
+  return true;
+}
 
-      while (p1)
-      {
-        p0 = p1;
 
-        // overwrite next separator
+// parse a (signed) integer, returns false if none found
+static bool obj_parse_int(const char*& p, int& i)
+{
+  bool negative = (*p == '-');
+  if (*p == '-' || *p == '+') ++p;
+  if (!obj_is_digit(*p)) return false;
 
-        // skip '/', '\n', ' ', '\0', '\r' <-- don't forget Windows
-        while (*p1!='/' && *p1!='\r' && *p1!='\n' && *p1!=' ' && *p1!='\0') ++p1;
+  for (i=0; obj_is_digit(*p); ++p) i = i*10 + (*p-'0');
+  if (negative) i = -i;
+  return true;
+}
 
-        // detect end of vertex
-        if (*p1 != '/')
-        {
-          endOfVertex = true;
-        }
 
-        // replace separator by '\0'
-        if (*p1 != '\0')
-        {
-          *p1 = '\0';
-          p1++; // point to next token
-        }
+// parse the vertex positions and faces of [begin,end), which holds whole lines
+static void obj_parse_chunk(Obj_chunk& chunk)
+{
+  const char* p = chunk.begin;
 
-        // detect end of line and break
-        if (*p1 == '\0' || *p1 == '\n')
-        {
-          p1 = 0;
-        }
+  while (p < chunk.end)
+  {
+    // vertex
+    if (p[0]=='v' && obj_is_blank(p[1]))
+    {
+      float x(0), y(0), z(0);
+      p += 1;
+      if (obj_parse_float(p, x))
+      {
+        if (obj_parse_float(p, y)) obj_parse_float(p, z);
+        chunk.points.push_back(x);
+        chunk.points.push_back(y);
+        chunk.points.push_back(z);
+      }
+    }
 
-        // read next vertex component
-        if (*p0 != '\0')
-        {
-          switch (component)
-          {
-            case 0: // vertex
-              vertices.push_back( Surface_mesh::Vertex(atoi(p0) + voffset) );
-              break;
-
-            case 1: // texture coord
-              break;
-
-            case 2: // normal
-              break;
-          }
-        }
+    // face: only the vertex index of each v/vt/vn triple is used
+    else if (p[0]=='f' && obj_is_blank(p[1]))
+    {
+      int nV(0), idx;
+      p += 1;
 
-        ++component;
+      while (true)
+      {
+        while (obj_is_blank(*p)) ++p;
+        if (obj_is_eol(*p)) break;
 
-        if (endOfVertex)
+        if (obj_parse_int(p, idx))
         {
-          component = 0;
-          nV++;
-          endOfVertex = false;
+          chunk.indices.push_back(idx);
+          ++nV;
         }
+
+        // skip the rest of the triple
+        while (!obj_is_blank(*p) && !obj_is_eol(*p)) ++p;
       }
 
-      mesh.add_face(vertices);
+      chunk.valences.push_back(nV);
     }
 
-
-    // clear line
-    memset(&s, 0, 200);
+    // skip to the next line (comments, normals, texture coordinates, groups..)
+    while (*p != '\n' && *p != '\0') ++p;
+    if (*p == '\n') ++p;
+    else break;
   }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool read_obj(Surface_mesh& mesh, const std::string& filename)
+{
+  // read the whole file (in binary mode, '\r' is handled by the parser)
+  FILE* in = fopen(filename.c_str(), "rb");
+  if (!in) return false;
 
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fseek(in, 0, SEEK_SET);
 
+  if (size < 0) { fclose(in); return false; }
+
+  std::vector<char> buffer(size + 1, '\0');
+  size_t n_read = fread(&buffer[0], 1, size, in);
   fclose(in);
+  buffer[n_read] = '\0';
+
+  const char* data = &buffer[0];
+  const char* data_end = data + n_read;
+
+
+  // split into chunks at line boundaries
+  std::vector<Obj_chunk> chunks;
+  for (const char* p = data; p < data_end; )
+  {
+    const char* q = (data_end - p > OBJ_CHUNK_SIZE) ? p + OBJ_CHUNK_SIZE : data_end;
+    while (q < data_end && *(q-1) != '\n') ++q;
+
+    chunks.push_back(Obj_chunk());
+    chunks.back().begin = p;
+    chunks.back().end   = q;
+    p = q;
+  }
+
+
+  // parse chunks in parallel
+  #pragma omp parallel for if(chunks.size() > 1)
+  for (int i = 0; i < (int)chunks.size(); i++)
+    obj_parse_chunk(chunks[i]);
+
+
+  // if mesh is not empty we need an offset for vertex indices
+  // also take into accout that OBJ indices start at 1 (not 0)
+  const int voffset = mesh.n_vertices() - 1;
+
+  unsigned int nV(0), nF(0), nI(0);
+  for (unsigned int i = 0; i < chunks.size(); i++)
+  {
+    nV += chunks[i].points.size() / 3;
+    nF += chunks[i].valences.size();
+    nI += chunks[i].indices.size();
+  }
+
+  mesh.reserve(mesh.n_vertices() + nV, mesh.n_edges() + nI/2, mesh.n_faces() + nF);
+
+
+  // add vertices, then faces, in file order
+  for (unsigned int i = 0; i < chunks.size(); i++)
+  {
+    const std::vector<float>& points = chunks[i].points;
+    for (unsigned int j = 0; j < points.size(); j += 3)
+      mesh.add_vertex(Point(points[j], points[j+1], points[j+2]));
+  }
+
+  const int nVertices = mesh.n_vertices();
+  std::vector<Surface_mesh::Vertex>  vertices;
+
+  for (unsigned int i = 0; i < chunks.size(); i++)
+  {
+    const std::vector<int>& indices  = chunks[i].indices;
+    const std::vector<int>& valences = chunks[i].valences;
+
+    for (unsigned int f = 0, k = 0; f < valences.size(); k += valences[f], f++)
+    {
+      vertices.clear();
+
+      bool valid = (valences[f] >= 3);
+      for (int j = 0; j < valences[f]; j++)
+      {
+        int idx = indices[k + j] + voffset;
+        if (idx < 0 || idx >= nVertices) valid = false;
+        vertices.push_back(Surface_mesh::Vertex(idx));
+      }
+
+      if (valid) mesh.add_face(vertices);
+    }
+  }
+
+
   return true;
 }
 
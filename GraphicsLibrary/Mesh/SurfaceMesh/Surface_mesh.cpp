@@ -349,18 +349,22 @@ add_face(const std::vector<Vertex>& vertices)
 {
     Vertex                   v;
     unsigned int             i, ii, n((int)vertices.size()), id;
-    std::vector<Halfedge>    halfedges(n);
-    std::vector<bool>        is_new(n), needs_adjust(n, false);
     Halfedge                 inner_next, inner_prev,
     outer_next, outer_prev,
     boundary_next, boundary_prev,
     patch_start, patch_end;
 
-    // cache for set_next_halfedge and vertex' set_halfedge
-    typedef std::pair<Halfedge, Halfedge>  NextCacheEntry;
-    typedef std::vector<NextCacheEntry>    NextCache;
+    // reuse the member buffers, they keep their capacity between calls
+    std::vector<Halfedge>&   halfedges    = add_face_halfedges_;
+    std::vector<bool>&       is_new       = add_face_is_new_;
+    std::vector<bool>&       needs_adjust = add_face_needs_adjust_;
+    halfedges.resize(n);
+    is_new.resize(n);
+    needs_adjust.assign(n, false);
 
-    NextCache    next_cache;
+    // cache for set_next_halfedge and vertex' set_halfedge
+    NextCache&   next_cache = add_face_next_cache_;
+    next_cache.clear();
     next_cache.reserve(3*n);
 
 
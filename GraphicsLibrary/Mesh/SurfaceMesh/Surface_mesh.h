@@ -1534,6 +1534,14 @@ private: //------------------------------------------------------- private data
     unsigned int deleted_edges_;
     unsigned int deleted_faces_;
     bool garbage_;
+
+    // helper data for add_face(), kept to avoid reallocations when adding many faces
+    typedef std::pair<Halfedge, Halfedge>  NextCacheEntry;
+    typedef std::vector<NextCacheEntry>    NextCache;
+    std::vector<Halfedge>  add_face_halfedges_;
+    std::vector<bool>      add_face_is_new_;
+    std::vector<bool>      add_face_needs_adjust_;
+    NextCache              add_face_next_cache_;
 };
 
 /// @}
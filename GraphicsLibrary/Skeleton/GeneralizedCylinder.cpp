@@ -3,6 +3,19 @@
 #include "GraphicsLibrary/SpacePartition/Intersection.h"
 #include "ClosedPolygon.h"
 #include "Utility/SimpleDraw.h"
+#include "GraphicsLibrary/SpacePartition/BVH.h"
+
+// Boxes cut by a cross-section plane, for \BVH::collect
+struct PlaneStraddle{
+	Vec3d n, p;
+
+	int operator()(const Vec3d & bbmin, const Vec3d & bbmax) const
+	{
+		Vec3d c = (bbmin + bbmax) * 0.5, e = (bbmax - bbmin) * 0.5;
+		double r = fabs(n[0]) * e[0] + fabs(n[1]) * e[1] + fabs(n[2]) * e[2];
+		return (fabs(dot(n, c - p)) <= r) ? 1 : 0;
+	}
+};
 
 GeneralizedCylinder::GeneralizedCylinder( std::vector<Point> spinePoints, QSurfaceMesh * mesh, bool computeRadius /*= true */ )
 {
@@ -13,38 +26,109 @@ GeneralizedCylinder::GeneralizedCylinder( std::vector<Point> spinePoints, QSurfa
 	int numNonZero = 0;
 	double nonZeroRadius = 1.0;
 
-	// Build cross-section
-	for(uint i = 0; i < spinePoints.size(); i++)
+	int N = spinePoints.size();
+	std::vector<double> csRadius(N, 0.0);
+
+	if(computeRadius)
 	{
-		// Find radius from the cross-section
-		double radius = 0;
+		// Gather face corners once instead of per cross-section, faces of any valence
+		Surface_mesh::Vertex_property<Point> points = mesh->vertex_property<Point>("v:point");
+		int F = mesh->face_array.size();
+		std::vector<int> cornerStart(F + 1, 0);
+		std::vector<Vec3d> corners;
+		corners.reserve(F * 3);
 
-		if(computeRadius)
+		// Face index -> position in \face_array
+		std::vector<int> faceSlot(mesh->n_faces(), -1);
+
+		for(int fi = 0; fi < F; fi++)
 		{
-			std::vector<Point> cur_cs;
-		
-			ClosedPolygon polygon(frames.point[i]);
+			Surface_mesh::Vertex_around_face_circulator fvit, fvend;
+			fvit = fvend = mesh->vertices(mesh->face_array[fi]);
 
-			for(uint fi = 0; fi < mesh->face_array.size(); fi++)
-			{
-				Vec3d p1, p2;
+			do{
+				corners.push_back(points[fvit]);
+			} while (++fvit != fvend);
 
-				if(ContourFacet(frames.U[i].t, frames.point[i], mesh->facePoints(mesh->face_array[fi]), p1, p2) > 0)
-					polygon.insertLine(p1,p2);
-			}
+			cornerStart[fi + 1] = corners.size();
+			faceSlot[Surface_mesh::Face(mesh->face_array[fi]).idx()] = fi;
+		}
 
-			polygon.close();
+		// Face index, each cross-section only visits the faces whose bounds its plane cuts
+		BVH faceBVH;
+		faceBVH.build(mesh);
+
+		// Cross-sections are independent of each other
+		#pragma omp parallel
+		{
+			std::vector<uint> candidates;
+			std::vector<Vec3d> face(3);
 
-			// Sort based on distance and filter based on segment distance
-			foreach(Point p, polygon.closedPoints)
+			#pragma omp for
+			for(int i = 0; i < N; i++)
 			{
-				radius = Max(radius, (p - frames.point[i]).norm());
-			}
+				double radius = 0;
+
+				PlaneStraddle plane;
+				plane.n = frames.U[i].t;
+				plane.p = frames.point[i];
+
+				candidates.clear();
+				faceBVH.collect(plane, candidates);
+
+				ClosedPolygon polygon(frames.point[i]);
 
-			// Some filters to be fail-safe
-			if(nonZeroRadius == 0 && radius != 0)	nonZeroRadius = radius;
-			if(radius > 10 * nonZeroRadius)	radius = 0;
+				for(uint j = 0; j < candidates.size(); j++)
+				{
+					int fi = faceSlot[candidates[j]];
+					if(fi < 0) continue;
+
+					int begin = cornerStart[fi], end = cornerStart[fi + 1];
+
+					// Signed distances of the corners to the cross-section plane
+					double lo = DBL_MAX, hi = -DBL_MAX;
+					for(int c = begin; c < end; c++)
+					{
+						double side = dot(plane.n, corners[c] - plane.p);
+						lo = Min(lo, side);
+						hi = Max(hi, side);
+					}
+
+					// Face is entirely on one side of the plane
+					if(lo > 0 || hi < 0) continue;
+
+					// Triangle fan, the contour is computed per triangle
+					for(int c = begin + 1; c + 1 < end; c++)
+					{
+						face[0] = corners[begin]; face[1] = corners[c]; face[2] = corners[c + 1];
+
+						Vec3d p1, p2;
+
+						if(ContourFacet(plane.n, plane.p, face, p1, p2) > 0)
+							polygon.insertLine(p1,p2);
+					}
+				}
+
+				polygon.close();
+
+				// Sort based on distance and filter based on segment distance
+				foreach(Point p, polygon.closedPoints)
+				{
+					radius = Max(radius, (p - frames.point[i]).norm());
+				}
+
+				// Some filters to be fail-safe
+				if(radius > 10 * nonZeroRadius)	radius = 0;
+
+				csRadius[i] = radius;
+			}
 		}
+	}
+
+	// Build cross-section
+	for(int i = 0; i < N; i++)
+	{
+		double radius = csRadius[i];
 
 		crossSection.push_back(Circle(frames.point[i], radius, frames.U[i].t, i));
 
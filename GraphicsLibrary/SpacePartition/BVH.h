@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include "GraphicsLibrary/Mesh/QSurfaceMesh.h"
+
+// Bounding volume hierarchy over the faces of a mesh.
+// Built once per topology, then refitted when the vertices move.
+class BVH
+{
+public:
+	struct Node{
+		Vec3d bbmin, bbmax;
+		int left, right;		// Children, -1 for leaves
+		int start, count;		// Faces of leaves in \faceIds
+	};
+
+	BVH(){ mesh = NULL; }
+
+	void build(QSurfaceMesh * fromMesh, int facesPerLeaf = 8)
+	{
+		mesh = fromMesh;
+		nodes.clear();
+		faceIds.resize(mesh->n_faces());
+		centroids.resize(mesh->n_faces());
+
+		for(uint i = 0; i < faceIds.size(); i++){
+			faceIds[i] = i;
+			centroids[i] = mesh->faceCenter(Surface_mesh::Face(i));
+		}
+
+		if(!faceIds.empty()) buildNode(0, faceIds.size(), facesPerLeaf);
+
+		refit();
+	}
+
+	// Children are stored after their parent, so a reverse sweep updates bottom-up
+	void refit()
+	{
+		Surface_mesh::Vertex_property<Point> points = mesh->vertex_property<Point>("v:point");
+
+		for(int n = (int)nodes.size() - 1; n >= 0; n--)
+		{
+			Node & node = nodes[n];
+			node.bbmin = Vec3d( DBL_MAX,  DBL_MAX,  DBL_MAX);
+			node.bbmax = Vec3d(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+
+			if(node.left < 0)
+			{
+				for(int i = node.start; i < node.start + node.count; i++)
+				{
+					Surface_mesh::Vertex_around_face_circulator fvit = mesh->vertices(Surface_mesh::Face(faceIds[i])), fvend = fvit;
+					do{
+						node.bbmin.minimize(points[fvit]);
+						node.bbmax.maximize(points[fvit]);
+					} while(++fvit != fvend);
+				}
+			}
+			else
+			{
+				node.bbmin.minimize(nodes[node.left].bbmin);	node.bbmax.maximize(nodes[node.left].bbmax);
+				node.bbmin.minimize(nodes[node.right].bbmin);	node.bbmax.maximize(nodes[node.right].bbmax);
+			}
+		}
+	}
+
+	// \overlap(bbmin, bbmax) returns 0 when a box is out, 1 when partially in and 2 when completely in
+	template< typename Overlap >
+	void collect(const Overlap & overlap, std::vector<uint> & faces) const
+	{
+		if(nodes.empty()) return;
+		collectNode(0, overlap, faces);
+	}
+
+	int numFaces() const { return faceIds.size(); }
+
+	QSurfaceMesh * mesh;
+	std::vector<Node> nodes;
+	std::vector<uint> faceIds;
+
+private:
+	std::vector<Vec3d> centroids;
+
+	struct CentroidLess{
+		const std::vector<Vec3d> * c; int axis;
+		bool operator()(uint a, uint b) const { return (*c)[a][axis] < (*c)[b][axis]; }
+	};
+
+	int buildNode(int start, int count, int facesPerLeaf)
+	{
+		int n = nodes.size();
+		nodes.push_back(Node());
+		nodes[n].left = nodes[n].right = -1;
+		nodes[n].start = start;
+		nodes[n].count = count;
+
+		if(count <= facesPerLeaf) return n;
+
+		// Median split along the longest axis of the centroids
+		Vec3d cmin( DBL_MAX,  DBL_MAX,  DBL_MAX);
+		Vec3d cmax(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+		for(int i = start; i < start + count; i++){
+			cmin.minimize(centroids[faceIds[i]]);
+			cmax.maximize(centroids[faceIds[i]]);
+		}
+		Vec3d extent = cmax - cmin;
+
+		CentroidLess less;
+		less.c = &centroids;
+		less.axis = (extent[0] > extent[1]) ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+
+		int half = count / 2;
+		std::nth_element(faceIds.begin() + start, faceIds.begin() + start + half, faceIds.begin() + start + count, less);
+
+		int left = buildNode(start, half, facesPerLeaf);
+		int right = buildNode(start + half, count - half, facesPerLeaf);
+
+		nodes[n].left = left;
+		nodes[n].right = right;
+		nodes[n].count = 0;
+
+		return n;
+	}
+
+	template< typename Overlap >
+	void collectNode(int n, const Overlap & overlap, std::vector<uint> & faces) const
+	{
+		const Node & node = nodes[n];
+
+		int state = overlap(node.bbmin, node.bbmax);
+		if(state == 0) return;
+
+		if(state == 2 || node.left < 0)
+		{
+			collectAll(n, faces);
+			return;
+		}
+
+		collectNode(node.left, overlap, faces);
+		collectNode(node.right, overlap, faces);
+	}
+
+	void collectAll(int n, std::vector<uint> & faces) const
+	{
+		const Node & node = nodes[n];
+
+		if(node.left < 0)
+		{
+			faces.insert(faces.end(), faceIds.begin() + node.start, faceIds.begin() + node.start + node.count);
+			return;
+		}
+
+		collectAll(node.left, faces);
+		collectAll(node.right, faces);
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include "GraphicsLibrary/Mesh/QSurfaceMesh.h"
+#include "Voxel.h"
+
+#define VOXEL_EMPTY_KEY (~0ULL)
+
+// Open addressing hash set of voxels, each with an integer data (e.g. its index).
+// Coordinates are packed in 21 bits each, i.e. within [-2^20, 2^20)
+class VoxelSet
+{
+public:
+	VoxelSet(int expected = 0){ count = 0; reserve(expected); }
+
+	bool has(int x, int y, int z) const { return get(x,y,z) != -1; }
+
+	int get(int x, int y, int z) const
+	{
+		if(keys.empty()) return -1;
+
+		unsigned long long k = pack(x,y,z);
+		for(size_t i = slot(k); ; i = (i + 1) & mask)
+		{
+			if(keys[i] == k) return data[i];
+			if(keys[i] == VOXEL_EMPTY_KEY) return -1;
+		}
+	}
+
+	// Returns false if the voxel is already in
+	bool insert(int x, int y, int z, int d)
+	{
+		if(2 * (count + 1) > (int)keys.size())
+			rehash(Max(16, 2 * (int)keys.size()));
+
+		unsigned long long k = pack(x,y,z);
+		size_t i = slot(k);
+		for(; keys[i] != VOXEL_EMPTY_KEY; i = (i + 1) & mask)
+			if(keys[i] == k) return false;
+
+		keys[i] = k;
+		data[i] = d;
+		count++;
+		return true;
+	}
+
+	void reserve(int n)
+	{
+		int capacity = 16;
+		while(capacity < 2 * n) capacity *= 2;
+		if(capacity > (int)keys.size()) rehash(capacity);
+	}
+
+	void clear()
+	{
+		keys.clear(); data.clear(); count = 0; mask = 0;
+	}
+
+	int size() const { return count; }
+
+	std::vector<Voxel> getAll() const
+	{
+		std::vector<Voxel> all;
+		for(size_t i = 0; i < keys.size(); i++)
+			if(keys[i] != VOXEL_EMPTY_KEY) all.push_back(unpack(keys[i]));
+		return all;
+	}
+
+private:
+	std::vector<unsigned long long> keys;
+	std::vector<int> data;
+	size_t mask;
+	int count;
+
+	static unsigned long long pack(int x, int y, int z)
+	{
+		const unsigned long long M = (1ULL << 21) - 1, OFFSET = 1ULL << 20;
+		return (((unsigned long long)(x + OFFSET) & M) << 42)
+			| (((unsigned long long)(y + OFFSET) & M) << 21)
+			| ((unsigned long long)(z + OFFSET) & M);
+	}
+
+	static Voxel unpack(unsigned long long k)
+	{
+		const unsigned long long M = (1ULL << 21) - 1;
+		const int OFFSET = 1 << 20;
+		return Voxel(int((k >> 42) & M) - OFFSET, int((k >> 21) & M) - OFFSET, int(k & M) - OFFSET);
+	}
+
+	size_t slot(unsigned long long k) const
+	{
+		// 64-bit finalizer mix, then keep the low bits
+		k ^= k >> 33;	k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;	k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return (size_t)k & mask;
+	}
+
+	void rehash(int capacity)
+	{
+		std::vector<unsigned long long> oldKeys = keys;
+		std::vector<int> oldData = data;
+
+		keys.assign(capacity, VOXEL_EMPTY_KEY);
+		data.assign(capacity, -1);
+		mask = capacity - 1;
+
+		for(size_t j = 0; j < oldKeys.size(); j++)
+		{
+			if(oldKeys[j] == VOXEL_EMPTY_KEY) continue;
+
+			size_t i = slot(oldKeys[j]);
+			while(keys[i] != VOXEL_EMPTY_KEY) i = (i + 1) & mask;
+			keys[i] = oldKeys[j];
+			data[i] = oldData[j];
+		}
+	}
+};
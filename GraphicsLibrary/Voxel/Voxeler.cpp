@@ -14,31 +14,31 @@ Voxeler::Voxeler( QSurfaceMesh * src_mesh, double voxel_size, bool verbose /*= f
 
 	if(isVerbose) printf("Computing voxels..");
 
+	QElapsedTimer timer; timer.start();
+
 	mesh->assignFaceArray();
+	int F = (int)mesh->face_array.size();
 
-	// For each face in mesh
-	foreach(Surface_mesh::Face f, mesh->face_array)
-	{
-		FaceBounds fb = findFaceBounds( f );
+	// Voxels of each face, computed independently
+	std::vector< std::vector<Voxel> > faceVoxels(F);
 
-		for(int x = fb.minX; x <= fb.maxX; x++)
-		{
-			for(int y = fb.minY; y <= fb.maxY; y++)
-			{
-				for(int z = fb.minZ; z <= fb.maxZ; z++)
-				{
-					Voxel v(x,y,z);
+	#pragma omp parallel for schedule(dynamic, 64)
+	for(int i = 0; i < F; i++)
+		voxelizeFace(mesh->facePoints(mesh->face_array[i]), faceVoxels[i]);
 
-					if(isVoxelIntersects(v, f) && !kd.has(x,y,z)){
-						kd.insert3(v.x, v.y, v.z, voxels.size());
-						voxels.push_back( v );
-					}
-				}
-			}
+	// Merge in face order, same voxel order as a serial pass
+	for(int i = 0; i < F; i++)
+	{
+		foreach(Voxel v, faceVoxels[i])
+		{
+			if(voxelSet.insert(v.x, v.y, v.z, voxels.size()))
+				voxels.push_back( v );
 		}
 	}
 	
-	if(isVerbose) printf(".voxel count = %d.\n", (int)voxels.size());
+	if(isVerbose) printf(".voxel count = %d (%d ms).\n", (int)voxels.size(), (int)timer.elapsed());
+
+	if(isVerbose) compareWithReference();
 
 	// Inner / outer computation
 	//fillInsideOut(innerVoxels, outerVoxels);
@@ -70,14 +70,17 @@ void Voxeler::computeBounds()
 }
 
 FaceBounds Voxeler::findFaceBounds( QSurfaceMesh::Face f )
+{
+	return findFaceBounds( mesh->facePoints(f) );
+}
+
+FaceBounds Voxeler::findFaceBounds( const std::vector<Vec3d> & f_vec )
 {
 	FaceBounds fb;
 
 	double minx = 0, miny = 0, minz = 0;
 	double maxx = 0, maxy = 0, maxz = 0;
 
-	std::vector<Vec3d> f_vec =  mesh->facePoints(f);
-
 	minx = maxx = f_vec[0].x();
 	miny = maxy = f_vec[0].y();
 	minz = maxz = f_vec[0].z();
@@ -120,6 +123,134 @@ bool Voxeler::isVoxelIntersects( const Voxel& v, QSurfaceMesh::Face f )
 	return b.containsTriangle(f_vec[0], f_vec[1], f_vec[2]);
 }
 
+// Akenine-Moller's triangle/box overlap, as in BoundingBox::containsTriangle,
+// with every term that only depends on the x and y of the voxel center
+// evaluated once per row of voxels along z. The arithmetic of each term is
+// unchanged, so the result matches \isVoxelIntersects exactly.
+void Voxeler::voxelizeFace( const std::vector<Vec3d> & f_vec, std::vector<Voxel> & result )
+{
+	FaceBounds fb = findFaceBounds( f_vec );
+
+	const double h = voxelSize * 0.5;
+	const Vec3d & t0 = f_vec[0], & t1 = f_vec[1], & t2 = f_vec[2];
+
+	for(int x = fb.minX; x <= fb.maxX; x++)
+	{
+		double cx = x * voxelSize;
+		double v0x = t0[0] - cx, v1x = t1[0] - cx, v2x = t2[0] - cx;
+		double e0x = v1x - v0x, e1x = v2x - v1x, e2x = v0x - v2x;
+		double fex0 = fabsf(e0x), fex1 = fabsf(e1x), fex2 = fabsf(e2x);
+
+		// Bullet 1, x
+		if(Min(v0x, Min(v1x, v2x)) > h || Max(v0x, Max(v1x, v2x)) < -h) continue;
+
+		for(int y = fb.minY; y <= fb.maxY; y++)
+		{
+			double cy = y * voxelSize;
+			double v0y = t0[1] - cy, v1y = t1[1] - cy, v2y = t2[1] - cy;
+			double e0y = v1y - v0y, e1y = v2y - v1y, e2y = v0y - v2y;
+			double fey0 = fabsf(e0y), fey1 = fabsf(e1y), fey2 = fabsf(e2y);
+
+			// Bullet 1, y
+			if(Min(v0y, Min(v1y, v2y)) > h || Max(v0y, Max(v1y, v2y)) < -h) continue;
+
+			// Bullet 3, the three z tests (AXISTEST_Z12, Z0, Z12)
+			double p0, p1, p2, lo, hi, rad;
+			p1 = e0y*v1x - e0x*v1y;	p2 = e0y*v2x - e0x*v2y;
+			lo = Min(p1, p2); hi = Max(p1, p2); rad = fey0 * h + fex0 * h;
+			if(lo > rad || hi < -rad) continue;
+			p0 = e1y*v0x - e1x*v0y;	p1 = e1y*v1x - e1x*v1y;
+			lo = Min(p0, p1); hi = Max(p0, p1); rad = fey1 * h + fex1 * h;
+			if(lo > rad || hi < -rad) continue;
+			p1 = e2y*v1x - e2x*v1y;	p2 = e2y*v2x - e2x*v2y;
+			lo = Min(p1, p2); hi = Max(p1, p2); rad = fey2 * h + fex2 * h;
+			if(lo > rad || hi < -rad) continue;
+
+			for(int z = fb.minZ; z <= fb.maxZ; z++)
+			{
+				double cz = z * voxelSize;
+				double v0z = t0[2] - cz, v1z = t1[2] - cz, v2z = t2[2] - cz;
+				double e0z = v1z - v0z, e1z = v2z - v1z, e2z = v0z - v2z;
+				double fez0 = fabsf(e0z), fez1 = fabsf(e1z), fez2 = fabsf(e2z);
+
+				// Bullet 1, z
+				if(Min(v0z, Min(v1z, v2z)) > h || Max(v0z, Max(v1z, v2z)) < -h) continue;
+
+				// Bullet 3, x tests (AXISTEST_X01, X01, X2)
+				p0 = e0z*v0y - e0y*v0z;	p2 = e0z*v2y - e0y*v2z;
+				lo = Min(p0, p2); hi = Max(p0, p2); rad = fez0 * h + fey0 * h;
+				if(lo > rad || hi < -rad) continue;
+				p0 = e1z*v0y - e1y*v0z;	p2 = e1z*v2y - e1y*v2z;
+				lo = Min(p0, p2); hi = Max(p0, p2); rad = fez1 * h + fey1 * h;
+				if(lo > rad || hi < -rad) continue;
+				p0 = e2z*v0y - e2y*v0z;	p1 = e2z*v1y - e2y*v1z;
+				lo = Min(p0, p1); hi = Max(p0, p1); rad = fez2 * h + fey2 * h;
+				if(lo > rad || hi < -rad) continue;
+
+				// Bullet 3, y tests (AXISTEST_Y02, Y02, Y1)
+				p0 = -e0z*v0x + e0x*v0z;	p2 = -e0z*v2x + e0x*v2z;
+				lo = Min(p0, p2); hi = Max(p0, p2); rad = fez0 * h + fex0 * h;
+				if(lo > rad || hi < -rad) continue;
+				p0 = -e1z*v0x + e1x*v0z;	p2 = -e1z*v2x + e1x*v2z;
+				lo = Min(p0, p2); hi = Max(p0, p2); rad = fez1 * h + fex1 * h;
+				if(lo > rad || hi < -rad) continue;
+				p0 = -e2z*v0x + e2x*v0z;	p1 = -e2z*v1x + e2x*v1z;
+				lo = Min(p0, p1); hi = Max(p0, p1); rad = fez2 * h + fex2 * h;
+				if(lo > rad || hi < -rad) continue;
+
+				// Bullet 2, plane of the triangle (planeBoxOverlap)
+				Vec3d n = cross(Vec3d(e0x, e0y, e0z), Vec3d(e1x, e1y, e1z));
+				Vec3d v0(v0x, v0y, v0z), vmin, vmax;
+				for(int q = 0; q < 3; q++)
+				{
+					if(n[q] > 0.0)	{ vmin[q] = -h - v0[q];	vmax[q] =  h - v0[q]; }
+					else			{ vmin[q] =  h - v0[q];	vmax[q] = -h - v0[q]; }
+				}
+				if(dot(n, vmin) > 0.0 || !(dot(n, vmax) >= 0.0)) continue;
+
+				result.push_back( Voxel(x, y, z) );
+			}
+		}
+	}
+}
+
+void Voxeler::compareWithReference()
+{
+	if(mesh == NULL) return;
+
+	QElapsedTimer timer; timer.start();
+
+	VoxelSet reference;
+	int count = 0;
+
+	foreach(Surface_mesh::Face f, mesh->face_array)
+	{
+		FaceBounds fb = findFaceBounds( f );
+
+		for(int x = fb.minX; x <= fb.maxX; x++)
+			for(int y = fb.minY; y <= fb.maxY; y++)
+				for(int z = fb.minZ; z <= fb.maxZ; z++)
+					if(isVoxelIntersects(Voxel(x,y,z), f) && reference.insert(x, y, z, count))
+						count++;
+	}
+
+	int referenceTime = timer.elapsed();
+	timer.restart();
+
+	std::vector<Voxel> rows;
+	foreach(Surface_mesh::Face f, mesh->face_array)
+		voxelizeFace(mesh->facePoints(f), rows);
+
+	int rowTime = timer.elapsed();
+
+	bool isSame = (count == (int)voxels.size());
+	foreach(Voxel v, voxels)
+		isSame &= reference.has(v.x, v.y, v.z);
+
+	printf("Voxelizing %d faces: per voxel %d ms, per row %d ms (single thread), %s\n",
+		(int)mesh->face_array.size(), referenceTime, rowTime, isSame ? "same voxels" : "DIFFERENT voxels");
+}
+
 void Voxeler::draw()
 {
 	if(!isReadyDraw)
@@ -142,14 +273,8 @@ void Voxeler::draw()
 
 	std::vector<Voxel> temp1, temp2;// = fillOther();
 
-	std::vector<double*> insideVoxels = innerVoxels.getAll();
-	std::vector<double*> outsideVoxels = outerVoxels.getAll();
-
-	foreach(double * pos, insideVoxels)
-		temp1.push_back(Voxel(pos[0], pos[1], pos[2]));
-
-	foreach(double * pos, outsideVoxels)
-		temp2.push_back(Voxel(pos[0], pos[1], pos[2]));
+	temp1 = innerVoxels.getAll();
+	temp2 = outerVoxels.getAll();
 
 	for(int i = 0; i < (int) temp1.size(); i++){
 		Vec3d c = temp1[i];
@@ -290,7 +415,7 @@ std::vector<Voxel> Voxeler::fillOther()
 	for(int x = minVox.x - 1; x <= maxVox.x + 1; x++){
 		for(int y = minVox.y - 1; y <= maxVox.y + 1; y++){
 			for(int z = minVox.z - 1; z <= maxVox.z + 1; z++){
-				if(!kd.has(x,y,z))
+				if(!voxelSet.has(x,y,z))
 					filled.push_back(Voxel(x,y,z));
 			}
 		}
@@ -299,7 +424,7 @@ std::vector<Voxel> Voxeler::fillOther()
 	return filled;
 }
 
-void Voxeler::fillInsideOut(KDTree & inside, KDTree & outside)
+void Voxeler::fillInsideOut(VoxelSet & inside, VoxelSet & outside)
 {
 	printf("Computing inside, outside..");
 
@@ -309,15 +434,15 @@ void Voxeler::fillInsideOut(KDTree & inside, KDTree & outside)
 	for(int x = minVox.x - 1; x <= maxVox.x + 1; x++){
 		for(int y = minVox.y - 1; y <= maxVox.y + 1; y++){
 			for(int z = minVox.z - 1; z <= maxVox.z + 1; z++){
-				if(!kd.has(x,y,z) && !outside.has(x,y,z)){
-					inside.insert3(x,y,z,1);
+				if(!voxelSet.has(x,y,z) && !outside.has(x,y,z)){
+					inside.insert(x,y,z,1);
 				}
 			}
 		}
 	}
 }
 
-void Voxeler::fillOuter(KDTree & outside)
+void Voxeler::fillOuter(VoxelSet & outside)
 {
 	std::stack<Voxel> stack;
 
@@ -330,10 +455,10 @@ void Voxeler::fillOuter(KDTree & outside)
 		stack.pop();
 
 		// Base case:
-		if( !kd.has(c.x, c.y, c.z) && !outside.has(c.x, c.y, c.z) )
+		if( !voxelSet.has(c.x, c.y, c.z) && !outside.has(c.x, c.y, c.z) )
 		{
 			// Otherwise, add it to set of outside voxels
-			outside.insert3(c.x, c.y, c.z, 1);
+			outside.insert(c.x, c.y, c.z, 1);
 
 			// Visit neighbors
 			if(c.x < maxVox.x + 1) stack.push( c + Voxel( 1, 0, 0) );
@@ -359,11 +484,12 @@ std::vector<Voxel> Voxeler::Intersects(Voxeler * other)
 		maxVoxeler = this;
 	}
 
+	// One hash probe per voxel of the smaller set
 	for(int i = 0; i < (int) minVoxeler->voxels.size(); i++)
 	{
-		Voxel v = minVoxeler->voxels[i];
+		const Voxel & v = minVoxeler->voxels[i];
 
-		if(maxVoxeler->kd.has(v.x, v.y, v.z))
+		if(maxVoxeler->voxelSet.has(v.x, v.y, v.z))
 			intersection.push_back(v);
 	}
 
@@ -383,10 +509,10 @@ std::map<int, Voxel> Voxeler::around(Point p)
 			for(int k = -1; k <= 1; k += 1){
 				Voxel v(x + i, y + j, z + k);
 
-				Vec3d vpos(v.x, v.y, v.z);
+				int idx = voxelSet.get(v.x, v.y, v.z);
 
-				if(kd.has(v.x, v.y, v.z)){
-					result[kd.getData(&vpos[0])] = v;
+				if(idx != -1){
+					result[idx] = v;
 				}
 			}
 		}
@@ -408,11 +534,8 @@ void Voxeler::grow()
 				for(int z = -1; z <= 1; z++){
 					Voxel v(curVoxel.x + x, curVoxel.y + y, curVoxel.z + z);
 
-					if(!kd.has(v.x,v.y,v.z))
-					{
-						kd.insert3(v.x, v.y, v.z, voxels.size());
+					if(voxelSet.insert(v.x, v.y, v.z, voxels.size()))
 						voxels.push_back( v );
-					}
 				}
 			}
 		}
@@ -440,9 +563,13 @@ int Voxeler::getClosestVoxel( Vec3d point )
 
 int Voxeler::getEnclosingVoxel( Vec3d point )
 {
-	int N = (int)voxels.size();
+	// Voxel centers sit at integer multiples of \voxelSize
+	int idx = voxelSet.get(floor(point.x() / voxelSize + 0.5), 
+		floor(point.y() / voxelSize + 0.5), floor(point.z() / voxelSize + 0.5));
+	if(idx != -1) return idx;
 
-	double s = voxelSize * 0.5;
+	// Outside the voxels, take the closest center
+	int N = (int)voxels.size();
 
 	double minDist = DBL_MAX;
 	int closestVoxel = -1;
@@ -451,7 +578,7 @@ int Voxeler::getEnclosingVoxel( Vec3d point )
 	{
 		Voxel curVoxel = voxels[i];
 
-		Point voxelCenter(curVoxel.x * s, curVoxel.y * s, curVoxel.z * s);
+		Point voxelCenter(curVoxel.x * voxelSize, curVoxel.y * voxelSize, curVoxel.z * voxelSize);
 
 		double curDist = (voxelCenter - point).norm();
 
@@ -466,15 +593,7 @@ int Voxeler::getEnclosingVoxel( Vec3d point )
 
 int Voxeler::getVoxelIndex( Voxel v )
 {
-	for(int i = 0; i < (int) voxels.size(); i++)
-	{
-		Voxel w = voxels[i];
-
-		if(w.x == v.x && w.y == v.y && w.z == v.z)
-			return i;
-	}
-
-	return -1;
+	return voxelSet.get(v.x, v.y, v.z);
 }
 
 std::vector< Point > Voxeler::getVoxelCenters()
@@ -3,6 +3,7 @@
 #include "GraphicsLibrary/Mesh/QSurfaceMesh.h"
 #include "GraphicsLibrary/SpacePartition/kdtree.h"
 #include "Voxel.h"
+#include "VoxelSet.h"
 #include "MathLibrary/Bounding/BoundingBox.h"
 
 #define glv glVertex3dv
@@ -12,16 +13,23 @@ class Voxeler
 {
 private:
 	QSurfaceMesh * mesh;
-	KDTree kd;
+	VoxelSet voxelSet;		// Voxel -> index in \voxels
 
 	// Special voxels
-	KDTree outerVoxels, innerVoxels;
+	VoxelSet outerVoxels, innerVoxels;
 
 public:
 	Voxeler( QSurfaceMesh * src_mesh, double voxel_size, bool verbose = false);
 
 	FaceBounds findFaceBounds( Surface_mesh::Face f );
+	FaceBounds findFaceBounds( const std::vector<Vec3d> & f_vec );
 	bool isVoxelIntersects( const Voxel & v, Surface_mesh::Face f );
+
+	// All voxels overlapping a triangle, row by row (same test as \isVoxelIntersects)
+	void voxelizeFace( const std::vector<Vec3d> & f_vec, std::vector<Voxel> & result );
+
+	// Time the per-voxel test against \voxelizeFace and check both agree (verbose mode)
+	void compareWithReference();
 	
 	void update();
 	void computeBounds();
@@ -31,8 +39,8 @@ public:
 
 	// Find inside and outside of mesh surface
 	std::vector< Voxel > fillOther();
-	void fillInsideOut(KDTree & inside, KDTree & outside);
-	void fillOuter(KDTree & outside);
+	void fillInsideOut(VoxelSet & inside, VoxelSet & outside);
+	void fillOuter(VoxelSet & outside);
 
 	// Intersection
 	std::vector<Voxel> Intersects(Voxeler * other);
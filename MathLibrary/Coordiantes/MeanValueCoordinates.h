@@ -1,21 +1,17 @@
 #pragma once
 
 #include "GraphicsLibrary/Mesh/QSurfaceMesh.h"
+#include <algorithm>
 
-class MeanValueCooridnates{
+// Cage flattened once (positions and triangle indices) so many points can be
+// evaluated against it without touching the halfedge structure
+class MeanValueCage{
 
 public:
-	static std::vector<double> weights(const Point& x, QSurfaceMesh * mesh)
+	MeanValueCage(QSurfaceMesh * mesh)
 	{
-		int npts = mesh->n_vertices();
-
-		// Initializing weights
-		std::vector<double> weights(npts);
-
-		// arrays storing point-to-vertex vectors and distances
-		std::vector<double> dist(npts);
-		std::vector<Vec3d> uVec(npts);
-		static const double eps = 0.00000001;
+		npts = mesh->n_vertices();
+		px.resize(npts); py.resize(npts); pz.resize(npts);
 
 		Surface_mesh::Vertex_property<Point> mesh_points = mesh->vertex_property<Point>("v:point");
 		Surface_mesh::Vertex_iterator vit, vend = mesh->vertices_end();
@@ -23,113 +19,201 @@ public:
 		for (vit = mesh->vertices_begin(); vit != vend; ++vit)
 		{
 			int pid = Surface_mesh::Vertex(vit).idx();
+			Point p = mesh_points[vit];
+			px[pid] = p[0]; py[pid] = p[1]; pz[pid] = p[2];
+		}
+
+		Surface_mesh::Face_iterator fit, fend = mesh->faces_end();
+
+		for (fit = mesh->faces_begin(); fit != fend; ++fit)
+		{
+			Surface_mesh::Vertex_around_face_circulator fvit = mesh->vertices(fit);
+			tri0.push_back(Surface_mesh::Vertex(fvit).idx()); ++fvit;
+			tri1.push_back(Surface_mesh::Vertex(fvit).idx()); ++fvit;
+			tri2.push_back(Surface_mesh::Vertex(fvit).idx());
+		}
+
+		ntris = tri0.size();
+	}
+
+	// Per-thread working memory, allocated once and reused for every query point
+	struct Scratch{
+		std::vector<double> dist, ux, uy, uz;
+		std::vector<double> theta0, theta1, theta2;
+		std::vector<double> w0, w1, w2;
+
+		Scratch(const MeanValueCage & cage)
+		{
+			dist.resize(cage.npts); ux.resize(cage.npts); uy.resize(cage.npts); uz.resize(cage.npts);
+			theta0.resize(cage.ntris); theta1.resize(cage.ntris); theta2.resize(cage.ntris);
+			w0.resize(cage.ntris); w1.resize(cage.ntris); w2.resize(cage.ntris);
+		}
+	};
 
-			// point-to-vertex vector
-			uVec[pid] = mesh_points[vit] - x;
+	int nbVertices() const { return npts; }
 
-			// distance
-			dist[pid] = uVec[pid].norm();
+	// Weights of 'x' written to w[0 .. nbVertices)
+	void weights(const Point& x, double * w, Scratch & s) const
+	{
+		static const double eps = 0.00000001;
+
+		// point-to-vertex vectors and distances
+		for (int pid = 0; pid < npts; pid++)
+		{
+			s.ux[pid] = px[pid] - x[0];
+			s.uy[pid] = py[pid] - x[1];
+			s.uz[pid] = pz[pid] - x[2];
+			s.dist[pid] = sqrt(s.ux[pid]*s.ux[pid] + s.uy[pid]*s.uy[pid] + s.uz[pid]*s.uz[pid]);
+		}
+
+		std::fill(w, w + npts, 0.0);
 
-			// handle special case when the point is really close to a vertex
-			if (dist[pid] < eps){
-				weights[pid] = 1.0;
-				return weights;
+		// handle special case when the point is really close to a vertex
+		for (int pid = 0; pid < npts; pid++)
+		{
+			if (s.dist[pid] < eps){
+				w[pid] = 1.0;
+				return;
 			}
+		}
 
-			// project onto unit sphere (normalize)
-			uVec[pid] /= dist[pid];
+		// project onto unit sphere (normalize)
+		for (int pid = 0; pid < npts; pid++)
+		{
+			double inv = 1.0 / s.dist[pid];
+			s.ux[pid] *= inv; s.uy[pid] *= inv; s.uz[pid] *= inv;
 		}
 
-		if(!mesh->triangles.size()) mesh->fillTrianglesList();
+		// angles
+		for (int fi = 0; fi < ntris; fi++)
+		{
+			int pid0 = tri0[fi], pid1 = tri1[fi], pid2 = tri2[fi];
+
+			double l0 = length(s, pid1, pid2);
+			double l1 = length(s, pid2, pid0);
+			double l2 = length(s, pid0, pid1);
+
+			s.theta0[fi] = 2.0*asin(l0/2.0);
+			s.theta1[fi] = 2.0*asin(l1/2.0);
+			s.theta2[fi] = 2.0*asin(l2/2.0);
+		}
 
-		// Now loop over all triangle to compute weights
-		for(int fi = 0; fi < mesh->triangles.size() / 3; fi++)
+		// special case when the point lies on a triangle
+		for (int fi = 0; fi < ntris; fi++)
 		{
-			// vertex id
-			int pid0 = mesh->triangles[3*fi + 0];
-			int pid1 = mesh->triangles[3*fi + 1];
-			int pid2 = mesh->triangles[3*fi + 2];
-
-			// unit vectors
-			Vec3d u0 (uVec[pid0]);
-			Vec3d u1 (uVec[pid1]);
-			Vec3d u2 (uVec[pid2]);
-
-			// edge lengths
-			double l0 = (u1 - u2).norm();
-			double l1 = (u2 - u0).norm();
-			double l2 = (u0 - u1).norm();
-
-			// angles
-			double theta0 = 2.0*asin(l0/2.0);
-			double theta1 = 2.0*asin(l1/2.0);
-			double theta2 = 2.0*asin(l2/2.0);
-			double halfSum = (theta0 + theta1 + theta2) / 2.0;
+			double theta0 = s.theta0[fi], theta1 = s.theta1[fi], theta2 = s.theta2[fi];
 
-			// special case when the point lies on the triangle
-			if (M_PI - halfSum < eps)
+			if (M_PI - (theta0 + theta1 + theta2) / 2.0 < eps)
 			{
-				weights.clear();
-				weights.resize(npts, 0.0); // clear all
+				int pid0 = tri0[fi], pid1 = tri1[fi], pid2 = tri2[fi];
 
-				weights[pid0] = sin(theta0) * dist[pid1] * dist[pid2];
-				weights[pid1] = sin(theta1) * dist[pid2] * dist[pid0];
-				weights[pid2] = sin(theta2) * dist[pid0] * dist[pid1];
+				w[pid0] = sin(theta0) * s.dist[pid1] * s.dist[pid2];
+				w[pid1] = sin(theta1) * s.dist[pid2] * s.dist[pid0];
+				w[pid2] = sin(theta2) * s.dist[pid0] * s.dist[pid1];
 
-				double sumWeight = weights[pid0] + weights[pid1] + weights[pid2];
+				double sumWeight = w[pid0] + w[pid1] + w[pid2];
 
-				weights[pid0] /= sumWeight;
-				weights[pid1] /= sumWeight;
-				weights[pid2] /= sumWeight;
+				w[pid0] /= sumWeight;
+				w[pid1] /= sumWeight;
+				w[pid2] /= sumWeight;
 
-				return weights;
+				return;
 			}
+		}
+
+		// Per-triangle contributions, branch free so the loop vectorizes
+		for (int fi = 0; fi < ntris; fi++)
+		{
+			int pid0 = tri0[fi], pid1 = tri1[fi], pid2 = tri2[fi];
+			double theta0 = s.theta0[fi], theta1 = s.theta1[fi], theta2 = s.theta2[fi];
+			double halfSum = (theta0 + theta1 + theta2) / 2.0;
 
 			// coefficient
 			double sinHalfSum = sin(halfSum);
-			double sinHalfSumSubTheta0 = sin(halfSum-theta0);
-			double sinHalfSumSubTheta1 = sin(halfSum-theta1);
-			double sinHalfSumSubTheta2 = sin(halfSum-theta2);
 			double sinTheta0 = sin(theta0), sinTheta1 = sin(theta1), sinTheta2 = sin(theta2);
 
-			double c0 = 2 * sinHalfSum * sinHalfSumSubTheta0 / sinTheta1 / sinTheta2 - 1;
-			double c1 = 2 * sinHalfSum * sinHalfSumSubTheta1 / sinTheta2 / sinTheta0 - 1;
-			double c2 = 2 * sinHalfSum * sinHalfSumSubTheta2 / sinTheta0 / sinTheta1 - 1;
+			double c0 = 2 * sinHalfSum * sin(halfSum-theta0) / sinTheta1 / sinTheta2 - 1;
+			double c1 = 2 * sinHalfSum * sin(halfSum-theta1) / sinTheta2 / sinTheta0 - 1;
+			double c2 = 2 * sinHalfSum * sin(halfSum-theta2) / sinTheta0 / sinTheta1 - 1;
 
-			if (fabs(c0) > 1) c0 = c0 > 0 ? 1 : -1;
-			if (fabs(c1) > 1) c1 = c1 > 0 ? 1 : -1;
-			if (fabs(c2) > 1) c2 = c2 > 0 ? 1 : -1;
+			c0 = Max(-1.0, Min(1.0, c0));
+			c1 = Max(-1.0, Min(1.0, c1));
+			c2 = Max(-1.0, Min(1.0, c2));
 
 			// sign
-			double det = Determinant3x3(u0, u1, u2);
-
-			// skip when less than eps
-			if (abs(det) < eps){
-				fi++; continue;
-			}
+			double det = s.ux[pid0] * (s.uy[pid1] * s.uz[pid2] - s.uz[pid1] * s.uy[pid2])
+				- s.uy[pid0] * (s.ux[pid1] * s.uz[pid2] - s.uz[pid1] * s.ux[pid2])
+				+ s.uz[pid0] * (s.ux[pid1] * s.uy[pid2] - s.uy[pid1] * s.ux[pid2]);
 
 			double detSign = det > 0 ? 1 : -1;
 			double sign0 = detSign * sqrt(1 - c0*c0);
 			double sign1 = detSign * sqrt(1 - c1*c1);
 			double sign2 = detSign * sqrt(1 - c2*c2);
 
-			// if 'x' lies on the plane of current triangle but outside it, ignore the current triangle
-			if (abs(sign0) < eps || abs(sign1) < eps || abs(sign2) < eps)
-			{
-				fi++; continue;
-			}
+			// skip degenerate triangles, and those whose plane contains 'x' outside of them
+			bool valid = fabs(det) >= eps && fabs(sign0) >= eps && fabs(sign1) >= eps && fabs(sign2) >= eps;
+
+			s.w0[fi] = valid ? (theta0-c1*theta2-c2*theta1) / (s.dist[pid0]*sinTheta1*sign2) : 0.0;
+			s.w1[fi] = valid ? (theta1-c2*theta0-c0*theta2) / (s.dist[pid1]*sinTheta2*sign0) : 0.0;
+			s.w2[fi] = valid ? (theta2-c0*theta1-c1*theta0) / (s.dist[pid2]*sinTheta0*sign1) : 0.0;
+		}
 
-			// weight 
-			weights[pid0] += (theta0-c1*theta2-c2*theta1) / (dist[pid0]*sinTheta1*sign2);
-			weights[pid1] += (theta1-c2*theta0-c0*theta2) / (dist[pid1]*sinTheta2*sign0);
-			weights[pid2] += (theta2-c0*theta1-c1*theta0) / (dist[pid2]*sinTheta0*sign1);
+		for (int fi = 0; fi < ntris; fi++)
+		{
+			w[tri0[fi]] += s.w0[fi];
+			w[tri1[fi]] += s.w1[fi];
+			w[tri2[fi]] += s.w2[fi];
 		}
 
 		// normalize weight
 		double sumWeight = 0.0;
-		for (int pid=0; pid < npts; ++pid)	sumWeight += weights[pid];
+		for (int pid=0; pid < npts; ++pid)	sumWeight += w[pid];
 		if(!sumWeight) printf("WARNING: zero weights.\n");
-		for (int pid=0; pid < npts; ++pid)	weights[pid] /= sumWeight;
+		for (int pid=0; pid < npts; ++pid)	w[pid] /= sumWeight;
+	}
+
+	// Weights of all points packed row-major, nbVertices() per point
+	std::vector<double> weights(const std::vector<Point>& pnts) const
+	{
+		int N = pnts.size();
+		std::vector<double> W(N * npts, 0.0);
+
+		if(!N || !npts) return W;
+
+		#pragma omp parallel
+		{
+			Scratch s(*this);
+
+			#pragma omp for
+			for(int i = 0; i < N; i++)
+				weights(pnts[i], &W[i * npts], s);
+		}
+
+		return W;
+	}
+
+private:
+	inline double length(const Scratch & s, int a, int b) const
+	{
+		double dx = s.ux[a] - s.ux[b], dy = s.uy[a] - s.uy[b], dz = s.uz[a] - s.uz[b];
+		return sqrt(dx*dx + dy*dy + dz*dz);
+	}
+
+	int npts, ntris;
+	std::vector<double> px, py, pz;
+	std::vector<int> tri0, tri1, tri2;
+};
+
+class MeanValueCooridnates{
+
+public:
+	static std::vector<double> weights(const Point& x, QSurfaceMesh * mesh)
+	{
+		MeanValueCage cage(mesh);
+		MeanValueCage::Scratch s(cage);
+
+		std::vector<double> weights(cage.nbVertices());
+		if(weights.size()) cage.weights(x, &weights[0], s);
 
 		return weights;
 	}
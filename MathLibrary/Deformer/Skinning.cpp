@@ -3,23 +3,72 @@
 #include "DualQuat.h"
 #include "Utility/Macros.h"
 #include "GraphicsLibrary/Basic/Plane.h"
+#include <algorithm>
 
-Skinning::Skinning( QSurfaceMesh * src_mesh, GeneralizedCylinder * using_gc )
+// Vertices within this factor of the interpolated radius are bound to a segment
+#define SKINNING_RADIUS_SCALE 1.2
+
+Skinning::Skinning( QSurfaceMesh * src_mesh, GeneralizedCylinder * using_gc, const std::vector<double> * packedCoords )
 {
 	this->mesh = src_mesh;
 	this->currGC = using_gc;
 	this->origGC = *currGC;
 
-	computeMeshCoordinates();
+	int nv = mesh->n_vertices();
+
+	if(packedCoords && (int)packedCoords->size() == 6 * nv)
+	{
+		// Previously computed for the same mesh and GC
+		const std::vector<double> & c = *packedCoords;
+		coordN1.resize(nv); coordN2.resize(nv);
+		coordTime.resize(nv); coordOffset.resize(nv);
+
+		for (int vi = 0; vi < nv; vi++)
+		{
+			coordN1[vi] = (int)c[6*vi + 0];
+			coordN2[vi] = (int)c[6*vi + 1];
+			coordTime[vi] = c[6*vi + 2];
+			coordOffset[vi] = Vec3d(c[6*vi + 3], c[6*vi + 4], c[6*vi + 5]);
+		}
+	}
+	else
+		computeMeshCoordinates();
+}
+
+std::vector<double> Skinning::packedCoordinates()
+{
+	int nv = coordN1.size();
+	std::vector<double> c(6 * nv);
+
+	for (int vi = 0; vi < nv; vi++)
+	{
+		c[6*vi + 0] = coordN1[vi];
+		c[6*vi + 1] = coordN2[vi];
+		c[6*vi + 2] = coordTime[vi];
+		c[6*vi + 3] = coordOffset[vi][0];
+		c[6*vi + 4] = coordOffset[vi][1];
+		c[6*vi + 5] = coordOffset[vi][2];
+	}
+
+	return c;
 }
 
-Skinning::SkinningCoord Skinning::computeCoordinates( GeneralizedCylinder *gc, Point& v )
+Skinning::SkinningCoord Skinning::computeCoordinates( GeneralizedCylinder *gc, Point& v, const SegmentBVH * bvh )
 {
-	// Go over the skeleton for the closest segment
+	// Candidate segments, only those whose padded bounds contain \v when a BVH is given
+	std::vector<int> candidates;
+	if(bvh)
+		bvh->query(v, candidates);
+	else
+		for(int i = 0; i < (int)gc->crossSection.size() - 1; i++) candidates.push_back(i);
+
+	// Go over the candidates for the closest segment
 	double minDis = DBL_MAX, minT = 0;
 	int minIdx = -1;
-	for(int i = 0; i < (int)gc->crossSection.size() - 1; i++)
+	for(int j = 0; j < (int)candidates.size(); j++)
 	{
+		int i = candidates[j];
+
 		GeneralizedCylinder::Circle & c1 = gc->crossSection[i];
 		GeneralizedCylinder::Circle & c2 = gc->crossSection[i+1];
 
@@ -30,10 +79,10 @@ Skinning::SkinningCoord Skinning::computeCoordinates( GeneralizedCylinder *gc, P
 		if(t >= 0.0 && t <= 1.0){
 
 			double dist = seg.distanceToUnbounded(v);
-			double radAt = ((c1.radius * (1-t)) + (c2.radius * t)) * 1.2;
+			double radAt = ((c1.radius * (1-t)) + (c2.radius * t)) * SKINNING_RADIUS_SCALE;
 
-			// Check inside GC
-			if( dist < radAt && dist < minDis )
+			// Check inside GC, ties go to the first segment
+			if( dist < radAt && (dist < minDis || (dist == minDis && i < minIdx)) )
 			{
 				minDis = dist;
 				minIdx = i;
@@ -76,13 +125,23 @@ void Skinning::computeMeshCoordinates()
 {
 	// The coordinates are computed based the original GC \origGC
 	Surface_mesh::Vertex_property<Point> points = mesh->vertex_property<Point>("v:point");
-	Surface_mesh::Vertex_iterator vit, vend = mesh->vertices_end();
 
-	coordinates.clear();
-	for (vit = mesh->vertices_begin(); vit != vend; ++vit)
+	origBVH.build(&origGC, SKINNING_RADIUS_SCALE);
+
+	int nv = mesh->n_vertices();
+	coordN1.resize(nv); coordN2.resize(nv);
+	coordTime.resize(nv); coordOffset.resize(nv);
+
+	#pragma omp parallel for
+	for (int vi = 0; vi < nv; vi++)
 	{
-		Vec3d v = points[vit];
-		coordinates.push_back(computeCoordinates(&origGC, v));
+		Vec3d v = points[Surface_mesh::Vertex(vi)];
+		SkinningCoord coord = computeCoordinates(&origGC, v, &origBVH);
+
+		coordN1[vi] = coord.n1;
+		coordN2[vi] = coord.n2;
+		coordTime[vi] = coord.time;
+		coordOffset[vi] = coord.d;
 	}
 }
 
@@ -237,13 +296,67 @@ Matrix3d Skinning::rotationOfCurve( int cid )
 
 void Skinning::deform()
 {
+	int N = currGC->crossSection.size();
+
+	// Rigid transform of each cross-section, computed once per update
+	std::vector<DualQuat> dq(N);
+	std::vector<Matrix3d> R(N);
+	std::vector<Vector3d> T(N);
+
+	for(int i = 0; i < N; i++)
+	{
+		Matrix3d Ri = rotationOfCurve(i);
+		Vector3d Ti = V2E(currGC->crossSection[i].center) - Ri * V2E(origGC.crossSection[i].center);
+
+		dq[i].SetTransform(Ri, Ti);
+		dq[i].GetTransform(R[i], T[i]);
+	}
+
 	Surface_mesh::Vertex_property<Point> points = mesh->vertex_property<Point>("v:point");
-	Surface_mesh::Vertex_iterator vit, vend = mesh->vertices_end();
 
-	for (vit = mesh->vertices_begin(); vit != vend; ++vit)
-	{		
-		int vi = Surface_mesh::Vertex(vit).idx();
-		points[vit] = fromCoordinates(origGC, coordinates[vi]);
+	int nv = coordTime.size();
+
+	#pragma omp parallel for
+	for (int vi = 0; vi < nv; vi++)
+	{
+		int i1 = coordN1[vi];
+		int i2 = coordN2[vi];
+		double w = coordTime[vi];
+
+		GeneralizedCylinder::Circle & orig_c1 = origGC.crossSection[i1];
+		GeneralizedCylinder::Circle & orig_c2 = origGC.crossSection[i2];
+		GeneralizedCylinder::Circle & c1 = currGC->crossSection[i1];
+		GeneralizedCylinder::Circle & c2 = currGC->crossSection[i2];
+
+		// Projection on the skeleton and scaling
+		Point proj;
+		double s;
+		Matrix3d Rb;
+		Vector3d Tb;
+
+		if (i1 == i2)
+		{
+			proj = orig_c1.center + orig_c1.n * w;
+			s = c1.radius / orig_c1.radius;
+			Rb = R[i1];
+			Tb = T[i1];
+		}
+		else
+		{
+			proj = orig_c1.center * (1.0-w) + orig_c2.center * w;
+
+			double orig_r = orig_c1.radius*(1.0-w) + orig_c2.radius*w;
+			double r = c1.radius*(1.0-w) + c2.radius*w;
+			s = r / orig_r;
+
+			// Dual quaternion blending
+			DualQuat dqb = dq[i1]*(1-w) + dq[i2]*w;
+			dqb.GetTransform(Rb, Tb);
+		}
+
+		Vector3d V = Rb * V2E((proj + coordOffset[vi] * s)) + Tb;
+
+		points[Surface_mesh::Vertex(vi)] = E2V(V);
 	}
 }
 
@@ -307,3 +420,119 @@ Point Skinning::closestProjection( Point v )
 
 	return p;
 }
+
+void SegmentBVH::build( GeneralizedCylinder * gc, double radiusScale )
+{
+	nodes.clear();
+	segIds.clear();
+
+	int nbSeg = (int)gc->crossSection.size() - 1;
+	if(nbSeg < 1) return;
+
+	segMin.resize(nbSeg);
+	segMax.resize(nbSeg);
+
+	for(int i = 0; i < nbSeg; i++)
+	{
+		GeneralizedCylinder::Circle & c1 = gc->crossSection[i];
+		GeneralizedCylinder::Circle & c2 = gc->crossSection[i+1];
+
+		double r = Max(c1.radius, c2.radius) * radiusScale;
+
+		for(int k = 0; k < 3; k++)
+		{
+			segMin[i][k] = Min(c1.center[k], c2.center[k]) - r;
+			segMax[i][k] = Max(c1.center[k], c2.center[k]) + r;
+		}
+
+		segIds.push_back(i);
+	}
+
+	nodes.reserve(2 * nbSeg);
+	buildNode(0, nbSeg);
+}
+
+struct SegmentCenterLess{
+	const std::vector<Vec3d> *segMin, *segMax;
+	int axis;
+
+	bool operator()(int a, int b) const
+	{
+		return (*segMin)[a][axis] + (*segMax)[a][axis] < (*segMin)[b][axis] + (*segMax)[b][axis];
+	}
+};
+
+int SegmentBVH::buildNode( int start, int count )
+{
+	int nid = nodes.size();
+	nodes.push_back(Node());
+
+	Vec3d bbmin(DBL_MAX), bbmax(-DBL_MAX);
+	for(int i = start; i < start + count; i++)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			bbmin[k] = Min(bbmin[k], segMin[segIds[i]][k]);
+			bbmax[k] = Max(bbmax[k], segMax[segIds[i]][k]);
+		}
+	}
+
+	nodes[nid].bbmin = bbmin;
+	nodes[nid].bbmax = bbmax;
+	nodes[nid].left = nodes[nid].right = -1;
+	nodes[nid].start = start;
+	nodes[nid].count = count;
+
+	if(count <= 2) return nid;
+
+	// Median split along the longest axis
+	Vec3d extent = bbmax - bbmin;
+	SegmentCenterLess less;
+	less.segMin = &segMin; less.segMax = &segMax;
+	less.axis = (extent[0] > extent[1]) ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+
+	int half = count / 2;
+	std::nth_element(segIds.begin() + start, segIds.begin() + start + half, segIds.begin() + start + count, less);
+
+	int left = buildNode(start, half);
+	int right = buildNode(start + half, count - half);
+
+	nodes[nid].left = left;
+	nodes[nid].right = right;
+
+	return nid;
+}
+
+void SegmentBVH::query( const Point& p, std::vector<int>& segments ) const
+{
+	if(nodes.empty()) return;
+
+	std::vector<int> stack;
+	stack.push_back(0);
+
+	while(!stack.empty())
+	{
+		const Node & node = nodes[stack.back()];
+		stack.pop_back();
+
+		if(p[0] < node.bbmin[0] || p[1] < node.bbmin[1] || p[2] < node.bbmin[2] ||
+			p[0] > node.bbmax[0] || p[1] > node.bbmax[1] || p[2] > node.bbmax[2])
+			continue;
+
+		if(node.left < 0)
+		{
+			for(int i = node.start; i < node.start + node.count; i++)
+			{
+				int sid = segIds[i];
+				if(p[0] >= segMin[sid][0] && p[1] >= segMin[sid][1] && p[2] >= segMin[sid][2] &&
+					p[0] <= segMax[sid][0] && p[1] <= segMax[sid][1] && p[2] <= segMax[sid][2])
+					segments.push_back(sid);
+			}
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
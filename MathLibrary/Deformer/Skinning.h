@@ -5,6 +5,27 @@
 #include <Eigen/Geometry>
 using namespace Eigen;
 
+// Bounding volume hierarchy over the spine segments of a GC, each segment
+// bounded by its end centers padded with the largest (scaled) radius
+class SegmentBVH{
+public:
+	void build(GeneralizedCylinder * gc, double radiusScale);
+	void query(const Point& p, std::vector<int>& segments) const;
+
+private:
+	struct Node{
+		Vec3d bbmin, bbmax;
+		int left, right;	// children, -1 for leaves
+		int start, count;	// range in \segIds for leaves
+	};
+
+	int buildNode(int start, int count);
+
+	std::vector<Node> nodes;
+	std::vector<int> segIds;
+	std::vector<Vec3d> segMin, segMax;
+};
+
 class Skinning{
 
 private:
@@ -20,16 +41,22 @@ private:
 	};
 
 public:
-	Skinning(QSurfaceMesh * src_mesh, GeneralizedCylinder * using_gc);
+	Skinning(QSurfaceMesh * src_mesh, GeneralizedCylinder * using_gc, const std::vector<double> * packedCoords = NULL);
 
 	void deform();
 	std::vector<double> getCoordinate(Point p);
 	Point fromCoordinates(std::vector<double> &coords);
 	bool atEnd( Point p );
+
+	// Mesh coordinates as (n1, n2, time, offset) per vertex
+	std::vector<double> packedCoordinates();
+
+	// The GC the coordinates are relative to
+	const GeneralizedCylinder & originalGC() const { return origGC; }
 	Point closestProjection(Point v);
 
 private:
-	SkinningCoord	computeCoordinates(GeneralizedCylinder *gc,  Point& v);
+	SkinningCoord	computeCoordinates(GeneralizedCylinder *gc,  Point& v, const SegmentBVH * bvh = NULL);
 	Point			fromCoordinates(GeneralizedCylinder &orig_gc, SkinningCoord coords);
 	void			computeMeshCoordinates();
 	Matrix3d		rotationOfCurve(int cid);
@@ -38,5 +65,10 @@ private:
 	QSurfaceMesh * mesh;
 	GeneralizedCylinder * currGC;
 	GeneralizedCylinder origGC;
-	std::vector< SkinningCoord > coordinates;
+	SegmentBVH origBVH;
+
+	// Mesh coordinates as separate arrays, see \SkinningCoord
+	std::vector< int > coordN1, coordN2;
+	std::vector< double > coordTime;
+	std::vector< Vec3d > coordOffset;
 };
@@ -3,6 +3,8 @@
 #include "Group.h"
 #include "Controller.h"
 
+#include <algorithm>
+
 ConstraintGraph::ConstraintGraph( Controller * controller )
 {
 	this->ctrl = controller;
@@ -27,91 +29,281 @@ ConstraintGraph::ConstraintGraph( Controller * controller )
 		adjacency_map[n1].push_back(edge1);
 		adjacency_map[n2].push_back(edge2);
 	}
+
+	// Flatten into CSR, nodes in the same order as \adjacency_map
+	foreach(QString id, adjacency_map.keys())
+	{
+		index[id] = nodes.size();
+		nodes.push_back(node(id));
+	}
+
+	int N = nodes.size();
+	numNeighbours.fill(0, N);
+
+	for (int i = 0; i < N; i++)
+	{
+		edgeStart.push_back(edgeTo.size());
+
+		foreach(Edge e, adjacency_map[nodes[i]->id])
+		{
+			GroupType type = ctrl->groups[e.id]->type;
+
+			edgeTo.push_back(index[e.to]);
+			edgeGroupType.push_back(type);
+			edgeGroup.push_back(e.id);
+
+			if (type != SYMMETRY) numNeighbours[i]++;
+		}
+	}
+	edgeStart.push_back(edgeTo.size());
 }
 
-Primitive * ConstraintGraph::node( QString id )
+int ConstraintGraph::nodeIndex( QString id )
 {
-	return ctrl->getPrimitive(id);
+	return index.value(id, -1);
 }
 
-QString ConstraintGraph::nextTarget()
+QVector<ConstraintGraph::Edge> ConstraintGraph::getConstraints( int target )
 {
-	// Symmetry first
-	Primitive * n1, * n2;
-	foreach(Group* p, ctrl->groups)
+	QVector<ConstraintGraph::Edge> constrains;
+
+	for (int k = edgeStart[target]; k < edgeStart[target + 1]; k++)
 	{
-		if (p->type == SYMMETRY)
+		Primitive * to = nodes[edgeTo[k]];
+
+		if (to->isFrozen)
+			constrains.push_back(Edge(edgeGroup[k], nodes[target]->id, to->id));
+	}
+
+	return constrains;
+}
+
+void ConstraintGraph::initFrontier()
+{
+	frontier = Frontier(this);
+	frontier.init();
+}
+
+int ConstraintGraph::nextTargetIndex()
+{
+	return frontier.next();
+}
+
+void ConstraintGraph::freeze( int v )
+{
+	frontier.freeze(v);
+}
+
+QVector< QVector<int> > ConstraintGraph::unfrozenComponents()
+{
+	int N = nodes.size();
+	QVector< QVector<int> > components;
+	QVector<bool> visited(N, false);
+
+	for (int s = 0; s < N; s++)
+	{
+		if (visited[s] || nodes[s]->isFrozen) continue;
+
+		// Flood through unfrozen nodes
+		QVector<int> component;
+		bool isSeeded = false;
+		QVector<int> stack(1, s);
+		visited[s] = true;
+
+		while (!stack.isEmpty())
 		{
-			n1 = p->nodes.first();
-			n2 = p->nodes.last();
-			if (n1->isFrozen != n2->isFrozen)
-				return (n1->isFrozen) ? n2->id : n1->id;
+			int v = stack.last();
+			stack.pop_back();
+			component.push_back(v);
+
+			for (int k = edgeStart[v]; k < edgeStart[v + 1]; k++)
+			{
+				int u = edgeTo[k];
+
+				if (nodes[u]->isFrozen)
+					isSeeded = true;
+				else if (!visited[u])
+				{
+					visited[u] = true;
+					stack.push_back(u);
+				}
+			}
 		}
+
+		// Nothing propagates into a component without frozen neighbours
+		if (!isSeeded) continue;
+
+		std::sort(component.begin(), component.end());
+		components.push_back(component);
 	}
 
-	// Find the most constrained free node
-	QString target = "";
-	double maxScore = 0.0;
-	foreach(Primitive * p, ctrl->getPrimitives())
+	return components;
+}
+
+ConstraintGraph::Frontier::Frontier( ConstraintGraph * graph )
+{
+	g = graph;
+}
+
+void ConstraintGraph::Frontier::init()
+{
+	QVector<int> all;
+
+	for (int v = 0; v < g->nodes.size(); v++)
+		if (!g->nodes[v]->isFrozen) all.push_back(v);
+
+	init(all);
+}
+
+void ConstraintGraph::Frontier::init( const QVector<int> & subset )
+{
+	int N = g->nodes.size();
+
+	isCandidate.fill(false, N);
+	numFrozen.fill(0, N);
+	hasFrozenPeer.fill(false, N);
+	heapPos.fill(-1, N);
+	heap.clear();
+
+	foreach(int v, subset)
 	{
-		// Skip frozen nodes
-		if(p->isFrozen) continue;
-
-		// Get all (non-symmetric) neighbours
-		QVector<QString> neighbours = getNeighbours(p->id);
-		int numFrozen = 0;
-		foreach(QString nei, neighbours)
-			if (node(nei)->isFrozen) numFrozen++;
-
-		// Update score
-		double score = (double)numFrozen / neighbours.size();
-		if (maxScore < score)
+		if (g->nodes[v]->isFrozen) continue;
+		isCandidate[v] = true;
+
+		for (int k = g->edgeStart[v]; k < g->edgeStart[v + 1]; k++)
 		{
-			maxScore = score;
-			target = p->id;
+			if (!g->nodes[g->edgeTo[k]]->isFrozen) continue;
+
+			if (g->edgeGroupType[k] == SYMMETRY)
+				hasFrozenPeer[v] = true;
+			else
+				numFrozen[v]++;
 		}
 	}
 
-	return target;
+	foreach(int v, subset)
+		if (isCandidate[v]) update(v);
 }
 
-// Non-symmetric neighbours
-QVector<QString> ConstraintGraph::getNeighbours( QString node )
+int ConstraintGraph::Frontier::next()
 {
-	QVector<QString> neighbours;
+	if (heap.isEmpty()) return -1;
 
-	foreach(Edge e, adjacency_map[node])
+	return heap.first();
+}
+
+void ConstraintGraph::Frontier::freeze( int v )
+{
+	g->nodes[v]->isFrozen = true;
+	isCandidate[v] = false;
+
+	// Remove \v from the frontier
+	int i = heapPos[v];
+	if (i >= 0)
 	{
-		if (ctrl->groups[e.id]->type != SYMMETRY)
+		int last = heap.last();
+		heap[i] = last;	heapPos[last] = i;
+		heap.pop_back();
+		heapPos[v] = -1;
+
+		if (last != v)
 		{
-			neighbours.push_back(e.to);
+			siftUp(i);
+			siftDown(heapPos[last]);
 		}
 	}
 
-	return neighbours;
+	// Neighbours become more constrained
+	for (int k = g->edgeStart[v]; k < g->edgeStart[v + 1]; k++)
+	{
+		int u = g->edgeTo[k];
+		if (!isCandidate[u]) continue;
+
+		if (g->edgeGroupType[k] == SYMMETRY)
+			hasFrozenPeer[u] = true;
+		else
+			numFrozen[u]++;
+
+		update(u);
+	}
 }
 
-QVector<ConstraintGraph::Edge> ConstraintGraph::getConstraints( QString target )
+double ConstraintGraph::Frontier::priority( int v )
 {
-	QVector<ConstraintGraph::Edge> constrains;
+	if (hasFrozenPeer[v]) return 2.0;
+	if (g->numNeighbours[v] == 0) return 0.0;
+
+	return (double)numFrozen[v] / g->numNeighbours[v];
+}
+
+bool ConstraintGraph::Frontier::higher( int u, int v )
+{
+	double pu = priority(u), pv = priority(v);
 
-	foreach(ConstraintGraph::Edge e, adjacency_map[target])
+	// Ties go to the first node, as in \nextTarget
+	return (pu > pv) || (pu == pv && u < v);
+}
+
+void ConstraintGraph::Frontier::siftUp( int i )
+{
+	while (i > 0)
 	{
-		if (node(e.to)->isFrozen)
-			constrains.push_back(e);
+		int parent = (i - 1) / 2;
+		if (!higher(heap[i], heap[parent])) break;
+
+		std::swap(heap[i], heap[parent]);
+		heapPos[heap[i]] = i;
+		heapPos[heap[parent]] = parent;
+		i = parent;
 	}
+}
 
-	return constrains;
+void ConstraintGraph::Frontier::siftDown( int i )
+{
+	int n = heap.size();
+
+	while (true)
+	{
+		int best = i, l = 2 * i + 1, r = l + 1;
+		if (l < n && higher(heap[l], heap[best])) best = l;
+		if (r < n && higher(heap[r], heap[best])) best = r;
+		if (best == i) break;
+
+		std::swap(heap[i], heap[best]);
+		heapPos[heap[i]] = i;
+		heapPos[heap[best]] = best;
+		i = best;
+	}
+}
+
+void ConstraintGraph::Frontier::update( int v )
+{
+	// Only nodes with some frozen neighbour are candidates
+	if (priority(v) <= 0) return;
+
+	// Priorities only grow, so sifting up is enough
+	if (heapPos[v] < 0)
+	{
+		heap.push_back(v);
+		heapPos[v] = heap.size() - 1;
+	}
+
+	siftUp(heapPos[v]);
+}
+
+Primitive * ConstraintGraph::node( QString id )
+{
+	return ctrl->getPrimitive(id);
 }
 
 QVector<ConstraintGraph::Edge> ConstraintGraph::getEdges( QString node )
 {
-	return adjacency_map[node].toVector();
+	return adjacency_map.value(node).toVector();
 }
 
 GroupType ConstraintGraph::edgeType( QString id )
 {
-	return ctrl->groups[id]->type;
+	return ctrl->groups.value(id)->type;
 }
 
 bool ConstraintGraph::hasRelation( QString id1, QString id2, GroupType type )
@@ -122,7 +314,7 @@ bool ConstraintGraph::hasRelation( QString id1, QString id2, GroupType type )
 	{
 		if ( node(e.to)->id == id2)
 		{
-			Group* group = ctrl->groups[e.id];
+			Group* group = ctrl->groups.value(e.id);
 			if (group->type == type )
 				return true;
 		}
@@ -3,6 +3,7 @@
 #include <QString>
 #include <QMap>
 #include <QList>
+#include <QVector>
 
 #include "Group.h"
 class Primitive;
@@ -26,9 +27,6 @@ public:
 
 	ConstraintGraph(Controller * controller = 0);
 
-	QString nextTarget();
-	QVector<QString> getNeighbours(QString node);
-	QVector<Edge> getConstraints(QString target);
 	QVector<Edge> getEdges( QString node );
 
 	GroupType edgeType(QString id);
@@ -38,6 +36,51 @@ public:
 	QMap< QString, QList<Edge> > adjacency_map;
 	Controller * controller() { return ctrl; }
 
+	// Compact integer-indexed copy of \adjacency_map (CSR)
+	QVector<Primitive*> nodes;		// Node index -> primitive
+	QVector<int>		edgeStart;	// Edges of node i are [edgeStart[i], edgeStart[i+1])
+	QVector<int>		edgeTo;
+	QVector<GroupType>	edgeGroupType;
+	QVector<QString>	edgeGroup;
+	int nodeIndex(QString id);
+	QVector<Edge> getConstraints(int target);
+
+	// Propagation frontier, a max-priority queue on the frozen neighbour ratio
+	class Frontier{
+	public:
+		Frontier(ConstraintGraph * graph = 0);
+		void	init();								// All nodes, from the current frozen flags
+		void	init(const QVector<int> & subset);	// Only nodes of \subset become targets
+		int		next();								// -1 if there is none
+		void	freeze(int v);						// Freeze \v and update its neighbours
+
+	private:
+		ConstraintGraph * g;
+		QVector<bool> isCandidate;
+		QVector<int> numFrozen;			// Non-symmetric edges to frozen nodes
+		QVector<bool> hasFrozenPeer;	// Frozen symmetric peer, goes first
+
+		QVector<int> heap, heapPos;
+		double	priority(int v);
+		bool	higher(int u, int v);
+		void	siftUp(int i);
+		void	siftDown(int i);
+		void	update(int v);
+	};
+	friend class Frontier;
+
+	void	initFrontier();
+	int		nextTargetIndex();
+	void	freeze(int v);
+
+	// Unfrozen nodes split by the frozen ones, only those next to a frozen node
+	QVector< QVector<int> > unfrozenComponents();
+
+private:
+	QMap<QString, int> index;
+	QVector<int> numNeighbours;		// Non-symmetric edges per node
+	Frontier frontier;
+
 public:
 	Controller * ctrl;
 	Primitive * node(QString id);
@@ -20,8 +20,42 @@
 #include "JointDetector.h"
 
 Controller::Controller( QSegMesh* mesh, bool useAABB /*= true*/, QString loadFromFile /* = ""*/ )
+{
+	init(mesh);
+
+	if(loadFromFile.isEmpty())
+	{
+		// Fit
+		fitOBBs(useAABB);
+	}
+	else
+	{
+		std::ifstream inF(qPrintable(loadFromFile), std::ios::in);
+		load(inF);
+		inF.close();
+	}
+
+	// Assign numerical IDs
+	assignIds();
+}
+
+Controller::Controller( QSegMesh* mesh, std::istream &inF, QMap<QString, std::vector<double> > &meshCoordinates )
+{
+	init(mesh);
+
+	// Skip computing the coordinates of the primitives that have them stored
+	cachedCoordinates = meshCoordinates;
+	meshCoordinates.clear();
+	load(inF);
+	cachedCoordinates.clear();
+
+	assignIds();
+}
+
+void Controller::init( QSegMesh* mesh )
 {
 	m_mesh = mesh;
+	isDeferred = false;
 
 	// BB
 	m_mesh->computeBoundingBox();
@@ -43,21 +77,6 @@ Controller::Controller( QSegMesh* mesh, bool useAABB /*= true*/, QString loadFro
 	groupTypes.push_back("COPLANNAR");
 	groupTypes.push_back("SELF_SYMMETRY");
 	groupTypes.push_back("SELF_ROT_SYMMETRY");
-
-	if(loadFromFile.isEmpty())
-	{
-		// Fit
-		fitOBBs(useAABB);
-	}
-	else
-	{
-		std::ifstream inF(qPrintable(loadFromFile), std::ios::in);
-		load(inF);
-		inF.close();
-	}
-
-	// Assign numerical IDs
-	assignIds();
 }
 
 Controller::~Controller()
@@ -333,18 +352,66 @@ ShapeState Controller::getShapeState()
 
 void Controller::setShapeState(const ShapeState &shapeState )
 {
+	// Set parameters only, the meshes are deformed together below
 	foreach(Primitive * prim, primitives)
 	{
-		prim->setState(shapeState.primStates[prim->id]);
+		prim->applyState(shapeState.primStates[prim->id]);
 	}
 
+	// Deferred meshes are materialized when sampled
+	if (!isDeferred) deformDirtyPrimitives();
+
 	m_mesh->vec["stacking_shift"] = shapeState.stacking_shift;
 	m_mesh->val["stackability"] = shapeState.stackability;
 
 	// Groups
 	this->groups = shapeState.groups;
+}
 
-	m_mesh->computeBoundingBox();
+void Controller::deformDirtyPrimitives()
+{
+	QVector<Primitive*> dirty;
+
+	foreach(Primitive * prim, primitives)
+	{
+		if(prim->isDirty) dirty.push_back(prim);
+	}
+
+	// Each primitive owns its segment, so they deform independently.
+	// A single primitive keeps its own inner parallel loop instead.
+	#pragma omp parallel for schedule(dynamic) if(dirty.size() > 1)
+	for(int i = 0; i < dirty.size(); i++)
+		dirty[i]->deformMesh();
+
+	// Segment bounds are refreshed by \deformMesh
+	m_mesh->updateBoundingBox();
+}
+
+void Controller::setDeferredDeformation( bool isDeferred )
+{
+	this->isDeferred = isDeferred;
+
+	foreach(Primitive * prim, primitives)
+		prim->isDeferred = isDeferred;
+
+	// Leave nothing pending when switching back
+	if (!isDeferred) deformDirtyPrimitives();
+}
+
+int Controller::numDeformations()
+{
+	int count = 0;
+
+	foreach(Primitive * prim, primitives)
+		count += prim->numDeformations;
+
+	return count;
+}
+
+void Controller::resetDeformationCount()
+{
+	foreach(Primitive * prim, primitives)
+		prim->numDeformations = 0;
 }
 
 QVector< Group * > Controller::groupsOf( QString id )
@@ -391,7 +458,7 @@ double Controller::similarity( ShapeState state1, ShapeState state2 )
 	return result;
 }
 
-void Controller::save( std::ofstream &outF )
+void Controller::save( std::ostream &outF )
 {
 	foreach(Primitive * prim, primitives)
 	{
@@ -405,7 +472,7 @@ void Controller::save( std::ofstream &outF )
 	}
 }
 
-void Controller::load( std::ifstream &inF )
+void Controller::load( std::istream &inF )
 {
 	clearPrimitives();
 
@@ -428,10 +495,23 @@ void Controller::load( std::ifstream &inF )
             case GCYLINDER: primitives[primId] = new GCylinder(m_mesh->getSegment(primId), primId, false); break;
 		}
 
+		if(cachedCoordinates.contains(primId))
+			primitives[primId]->cachedCoordinates.swap(cachedCoordinates[primId]);
+
 		primitives[primId]->load(inF, m_mesh->translation, m_mesh->scaleFactor);
 	}
 }
 
+QMap<QString, std::vector<double> > Controller::packedMeshCoordinates()
+{
+	QMap<QString, std::vector<double> > coords;
+
+	foreach(Primitive * prim, primitives)
+		coords[prim->id] = prim->packedMeshCoordinates();
+
+	return coords;
+}
+
 void Controller::removePrimitive( Primitive * prim )
 {
 	primitives.remove(prim->id);
@@ -486,7 +566,7 @@ std::vector<double> Controller::getDistortions()
 
 	// Change of BB extents along 3 main axes
 	Vec3d bbmin, bbmax;
-	m_mesh->computeBoundingBox();
+	deformDirtyPrimitives();
 	bbmin = m_mesh->bbmin;
 	bbmax = m_mesh->bbmax;
 	Vec3d orgSize = original_bbmax - original_bbmin;
@@ -516,7 +596,7 @@ double Controller::meshRadius()
 	return m_mesh->radius;
 }
 
-void Controller::loadGroups( std::ifstream &inF )
+void Controller::loadGroups( std::istream &inF )
 {
 	if (!inF) return;
 
@@ -585,7 +665,7 @@ void Controller::loadGroups( std::ifstream &inF )
 	}
 }
 
-void Controller::saveGroups( std::ofstream &outF )
+void Controller::saveGroups( std::ostream &outF )
 {
 	foreach(Group* group, groups)
 	{
@@ -16,6 +16,7 @@ class Controller
 {
 public:
 	Controller(QSegMesh* mesh, bool useAABB = true, QString loadFromFile = "" );
+	Controller(QSegMesh* mesh, std::istream &inF, QMap<QString, std::vector<double> > &meshCoordinates);
 	~Controller();
 
 public:
@@ -60,6 +61,12 @@ public:
 	// Shape state
 	ShapeState	getShapeState();
     void		setShapeState( const ShapeState &shapeState );
+	void		deformDirtyPrimitives();
+
+	// Deferred deformation
+	void	setDeferredDeformation(bool isDeferred);
+	int		numDeformations();
+	void	resetDeformationCount();
 	double		volume();
 	double		originalVolume();
 	double		getDistortion();
@@ -72,15 +79,16 @@ public:
 	void setPrimitivesFrozen(bool isFrozen = false);
 
 	// Save and load
-	void save(std::ofstream &outF);
-	void load(std::ifstream &inF);
+	void save(std::ostream &outF);
+	void load(std::istream &inF);
 	QString serialize();
 	void unserialize(QString &content);
+	QMap<QString, std::vector<double> > packedMeshCoordinates();
 
 	// Save and load groups
 	QVector<QString> groupTypes;
-	void saveGroups( std::ofstream &outF );
-	void loadGroups(std::ifstream &inF);
+	void saveGroups( std::ostream &outF );
+	void loadGroups(std::istream &inF);
 
 	// Debug items
 	std::vector<Point> debugPoints;
@@ -96,13 +104,19 @@ private:
 
 	QMap<QString, Primitive*> primitives;
 
+	bool isDeferred;
+
 	Vec3d original_bbmin, original_bbmax;
 
 	QVector<QString> primTypeNames;
 
 	QMap<int, QString> primitiveIdNum;
 
+	void init(QSegMesh* mesh);
 	void assignIds();
 
+	// Mesh coordinates handed to the primitives created by \load
+	QMap<QString, std::vector<double> > cachedCoordinates;
+
 };
 
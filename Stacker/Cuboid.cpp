@@ -3,6 +3,7 @@
 #include "Numeric.h"
 
 #include <Eigen/Geometry>
+#include <Eigen/Cholesky>
 using namespace Eigen;
 
 #include "MathLibrary/Bounding/OBB_PCA.h"
@@ -99,21 +100,29 @@ void Cuboid::fit( bool useAABB, int obb_method )
 
 void Cuboid::computeMeshCoordinates()
 {
-	// Compute the OBB coordinates for all vertices
-	coordinates.clear();
-	Surface_mesh::Vertex_property<Point> points = m_mesh->vertex_property<Point>("v:point");
-	Surface_mesh::Vertex_iterator vit, vend = m_mesh->vertices_end();
+	// Stored with the project
+	if(cachedCoordinates.size() == 8 * m_mesh->n_vertices())
+	{
+		coordinates.swap(cachedCoordinates);
+		cachedCoordinates.clear();
+		return;
+	}
+	cachedCoordinates.clear();
 
+	// Compute the OBB coordinates for all vertices
 	QSurfaceMesh cubeMesh = getGeometry();
-	cubeMesh.fillTrianglesList();
+	MeanValueCage cage(&cubeMesh);
+
+	coordinates = cage.weights(m_mesh->clonePoints());
+}
 
-	coordinates.resize(m_mesh->n_vertices(), std::vector<double>(cubeMesh.n_vertices()));
+std::vector<double> Cuboid::packedMeshCoordinates()
+{
+	// Only valid for the box they were computed in
+	if(!(currBox == originalBox) || currBox.faceScaling != originalBox.faceScaling)
+		return std::vector<double>();
 
-	#pragma omp parallel for
-	for(int i = 0; i < m_mesh->n_vertices(); i++)
-	{
-		coordinates[i] = MeanValueCooridnates::weights(points[Surface_mesh::Vertex(i)], &cubeMesh);
-	}
+	return coordinates;
 }
 
 Vec3d Cuboid::getCoordinatesInUniformBox( Box3 &box, Vec3d &p )
@@ -138,8 +147,10 @@ Vec3d Cuboid::getPositionInBox( std::vector<Vec3d> & pnts, int vidx )
 {
 	Vec3d p(0,0,0);
 
+	const double * w = &coordinates[vidx * pnts.size()];
+
 	for(int i = 0; i < pnts.size(); i++)
-		p += (pnts[i] * coordinates[vidx][i]);
+		p += (pnts[i] * w[i]);
 
 	return p;
 }
@@ -159,6 +170,9 @@ void Cuboid::deformMesh()
 	}
 
 	m_mesh->computeBoundingBox();
+
+	isDirty = false;
+	numDeformations++;
 }
 
 std::vector<Point> Cuboid::getUniformBoxCorners( Box3 &box )
@@ -537,7 +551,7 @@ void Cuboid::moveCurveCenter( int fid, Vec3d T )
 	}
 
 	// Deform the mesh
-	deformMesh();
+	requestDeformation();
 }
 
 //    joint
@@ -546,6 +560,56 @@ void Cuboid::moveCurveCenter( int fid, Vec3d T )
 //      |  \
 //      p  p+T
 
+// Least squares on the center and extents (axes are kept) so that each of
+// \coords lands on its target, the fixed points try to stay where they are
+void Cuboid::fitJoints( QVector< std::vector<double> > &coords, QVector<Point> &targets )
+{
+	QVector< std::vector<double> > C = coords;
+	QVector<Point> Q = targets;
+
+	foreach(Point fp, fixedPoints)
+	{
+		C.push_back(getCoordinate(fp));
+		Q.push_back(fp);
+	}
+
+	int K = C.size();
+	if (K == 0) return;
+
+	// p = Center + sum_i( Extent[i] * c[i] * Axis[i] ) is linear in the unknowns
+	MatrixXd A = MatrixXd::Zero(3 * K, 6);
+	VectorXd b(3 * K);
+
+	for (int k = 0; k < K; k++){
+		for (int d = 0; d < 3; d++)
+		{
+			int r = 3 * k + d;
+			A(r, d) = 1.0;
+			for (int i = 0; i < 3; i++)
+				A(r, 3 + i) = C[k][i] * currBox.Axis[i][d];
+			b(r) = Q[k][d];
+		}
+	}
+
+	// Extents without leverage (e.g. all joints on a mid plane) keep their value
+	MatrixXd AtA = A.transpose() * A;
+	VectorXd Atb = A.transpose() * b;
+	double lambda = 1e-6 * (AtA.trace() / 6 + 1);
+	for (int i = 0; i < 3; i++)
+	{
+		AtA(3 + i, 3 + i) += lambda;
+		Atb(3 + i) += lambda * currBox.Extent[i];
+	}
+
+	VectorXd x = AtA.ldlt().solve(Atb);
+
+	currBox.Center = Vec3d(x(0), x(1), x(2));
+	for (int i = 0; i < 3; i++)
+		if (x(3 + i) > 0) currBox.Extent[i] = x(3 + i);
+
+	requestDeformation();
+}
+
 void Cuboid::deformRespectToJoint( Vec3d joint, Vec3d p, Vec3d T )
 {
 	// Map points to uniform box coordinates
@@ -644,11 +708,18 @@ void* Cuboid::getState()
 
 void Cuboid::setState( void* toState)
 {
-	currBox = *( (Box3*) toState );
+	applyState(toState);
 
 	deformMesh();
 }
 
+void Cuboid::applyState( void* toState)
+{
+	currBox = *( (Box3*) toState );
+
+	isDirty = true;
+}
+
 void Cuboid::serialize( QTextStream &out)
 {
 	// Center
@@ -739,7 +810,7 @@ void Cuboid::reshape( std::vector<Point>& pnts, std::vector<double>& scales )
 
 	currBox.faceScaling = scales;
 
-	deformMesh();
+	requestDeformation();
 }
 
 bool Cuboid::containsPoint( Point p )
@@ -800,7 +871,7 @@ void Cuboid::movePoint( Point p, Vec3d T )
 		deformRespectToJoint(fixedPoints[0], p, T);
 	}
 
-	deformMesh();
+	requestDeformation();
 }
 
 void Cuboid::scaleCurve( int cid, double s )
@@ -821,10 +892,10 @@ void Cuboid::scaleCurve( int cid, double s )
 		}
 	}
 	
-	deformMesh();
+	requestDeformation();
 }
 
-void Cuboid::save( std::ofstream &outF )
+void Cuboid::save( std::ostream &outF )
 {
 	outF << this->currBox.Center << "\t" 
 		<< this->currBox.Axis[0] << "\t" 
@@ -840,7 +911,7 @@ void Cuboid::save( std::ofstream &outF )
 }
 
 
-void Cuboid::load( std::ifstream &inF, Vec3d translation, double scaleFactor )
+void Cuboid::load( std::istream &inF, Vec3d translation, double scaleFactor )
 {
 	this->currBox.faceScaling = std::vector<double>(6, 1.0);
 
@@ -919,7 +990,7 @@ void Cuboid::moveLineJoint( Point A, Point B, Vec3d deltaA, Vec3d deltaB )
 		deformRespectToJoint(joint, C, newC - C);
 	}
 	
-	deformMesh();
+	requestDeformation();
 }
 
 double Cuboid::curveRadius( int cid )
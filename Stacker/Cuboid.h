@@ -24,6 +24,7 @@ public:
 	void fit(){}
 	void fit(bool useAABB = true, int obb_method = 0);
 	void computeMeshCoordinates();
+	std::vector<double> packedMeshCoordinates();
 
 	// Deform the underlying geometry according to the \pre_state and current state
 	void deformMesh();
@@ -46,6 +47,7 @@ public:
 	void moveCurveCenter( int cid, Vec3d T);
 	void scaleCurve(int cid, double s);
 	void deformRespectToJoint( Vec3d joint, Vec3d p, Vec3d T);
+	void fitJoints( QVector< std::vector<double> > &coords, QVector<Point> &targets );
 
 	// Primitive coordinate system
 	std::vector<double> getCoordinate( Point v );
@@ -54,6 +56,7 @@ public:
 	// Primitive state
 	void*	getState();
 	void	setState( void* toState);
+	void	applyState( void* toState);
 
 	// Primitive geometry
 	double volume();
@@ -76,8 +79,8 @@ public:
 	Point getSelectedCurveCenter();
 
 	// Save and load
-	void save(std::ofstream &outF);
-	void load(std::ifstream &inF, Vec3d translation, double scaleFactor);
+	void save(std::ostream &outF);
+	void load(std::istream &inF, Vec3d translation, double scaleFactor);
 	void	serialize( QTextStream &out);
 	void	unserialize( QTextStream &in);
 
@@ -98,7 +101,7 @@ private:
 	bool isUsedAABB;
 
 public:
-	std::vector< std::vector<double> > coordinates;
+	std::vector<double> coordinates; // packed, one row of 8 corner weights per vertex
 
 	Box3 originalBox, currBox;
 };
@@ -0,0 +1,164 @@
+#include "Diagnostics.h"
+
+#include <QSet>
+#include <QQueue>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#define DIAG_QUEUE_SIZE 32
+
+struct DiagnosticsJob
+{
+	Buffer2d image;
+	QString fileName;
+};
+
+// Bounded queue of images, encoded and saved one by one
+class DiagnosticsWriter : public QThread
+{
+public:
+	DiagnosticsWriter() { isStopping = isWriting = false; numDropped = 0; }
+
+	bool push(const DiagnosticsJob& job)
+	{
+		QMutexLocker locker(&mutex);
+		if (jobs.size() >= DIAG_QUEUE_SIZE)
+		{
+			numDropped++;
+			return false;
+		}
+
+		jobs.enqueue(job);
+		hasJob.wakeOne();
+		return true;
+	}
+
+	void flush()
+	{
+		QMutexLocker locker(&mutex);
+		while (!jobs.isEmpty() || isWriting)
+			isIdle.wait(&mutex);
+	}
+
+	void stop()
+	{
+		mutex.lock();
+		isStopping = true;
+		hasJob.wakeOne();
+		mutex.unlock();
+
+		wait();
+	}
+
+	int numDropped;
+
+protected:
+	void run()
+	{
+		while (true)
+		{
+			mutex.lock();
+			while (jobs.isEmpty() && !isStopping)
+			{
+				isIdle.wakeAll();
+				hasJob.wait(&mutex);
+			}
+
+			// Pending images are still written when stopping
+			if (jobs.isEmpty())
+			{
+				isIdle.wakeAll();
+				mutex.unlock();
+				return;
+			}
+
+			DiagnosticsJob job = jobs.dequeue();
+			isWriting = true;
+			mutex.unlock();
+
+			saveAsImage(job.image, job.fileName);
+
+			mutex.lock();
+			isWriting = false;
+			mutex.unlock();
+		}
+	}
+
+private:
+	QQueue<DiagnosticsJob> jobs;
+	QMutex mutex;
+	QWaitCondition hasJob, isIdle;
+	bool isStopping, isWriting;
+};
+
+static QSet<QString> enabledChannels;
+static DiagnosticsWriter * writer = NULL;
+
+QStringList Diagnostics::channels()
+{
+	QStringList names;
+	names << DIAG_REGION_ENVELOPES << DIAG_REGION_OFFSET << DIAG_HOT_REGIONS;
+	return names;
+}
+
+void Diagnostics::setEnabled( QString channel, bool isEnabled )
+{
+	if (isEnabled)
+	{
+		enabledChannels.insert(channel);
+
+		// The writer is only started once something is to be written
+		if (!writer)
+		{
+			writer = new DiagnosticsWriter();
+			writer->start(QThread::LowPriority);
+		}
+	}
+	else
+		enabledChannels.remove(channel);
+}
+
+bool Diagnostics::isEnabled( QString channel )
+{
+	return !enabledChannels.isEmpty() && enabledChannels.contains(channel);
+}
+
+void Diagnostics::saveImage( QString channel, Buffer2d& image, QString fileName )
+{
+	if (!isEnabled(channel) || !writer) return;
+
+	DiagnosticsJob job;
+	job.image = image;
+	job.fileName = fileName;
+	writer->push(job);
+}
+
+void Diagnostics::saveRegions( QString channel, int w, int h, Buffer2v2i& regions, QString fileName )
+{
+	if (!isEnabled(channel) || !writer) return;
+
+	DiagnosticsJob job;
+	job.image = regionsImage(w, h, regions);
+	job.fileName = fileName;
+	writer->push(job);
+}
+
+int Diagnostics::numDropped()
+{
+	return writer ? writer->numDropped : 0;
+}
+
+void Diagnostics::flush()
+{
+	if (writer) writer->flush();
+}
+
+void Diagnostics::shutdown()
+{
+	if (!writer) return;
+
+	writer->stop();
+	delete writer;
+	writer = NULL;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include "Numeric.h"
+
+// Diagnostic images of the offset computation, written by a background thread.
+// Every channel is off by default, a disabled channel costs a set lookup and nothing else.
+#define DIAG_REGION_ENVELOPES	"Region envelopes"
+#define DIAG_REGION_OFFSET		"Region offset"
+#define DIAG_HOT_REGIONS		"Hot regions"
+
+class Diagnostics
+{
+public:
+	// Channels, only switched from the GUI thread
+	static QStringList channels();
+	static void setEnabled(QString channel, bool isEnabled);
+	static bool isEnabled(QString channel);
+
+	// Copy the data and queue it for writing, a full queue drops the request
+	static void saveImage(QString channel, Buffer2d& image, QString fileName);
+	static void saveRegions(QString channel, int w, int h, Buffer2v2i& regions, QString fileName);
+
+	// Writer thread
+	static int numDropped();
+	static void flush();
+	static void shutdown();
+};
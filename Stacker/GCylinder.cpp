@@ -7,6 +7,8 @@
 GCylinder::GCylinder( QSurfaceMesh* segment, QString newId, bool doFit) : Primitive(segment, newId)
 {
 	cage = NULL;
+	gcd = NULL;
+	skinner = NULL;
 
 	cageScale = 1.25;
 	cageSides = 16;
@@ -36,6 +38,8 @@ GCylinder::GCylinder( QSurfaceMesh* segment, QString newId, bool doFit) : Primit
 GCylinder::GCylinder( QSurfaceMesh* segment, QString newId) : Primitive(segment, newId)
 {
 	cage = NULL;
+	gcd = NULL;
+	skinner = NULL;
 	cageScale = 0;
 	cageSides = 0;
 	deltaScale = 0;
@@ -85,7 +89,33 @@ void GCylinder::computeMeshCoordinates()
 		gcd = new GCDeformation(m_mesh, cage);
 
 	if(deformer == SKINNING)
-		skinner = new Skinning(m_mesh, gc);
+		skinner = new Skinning(m_mesh, gc, &cachedCoordinates);
+
+	cachedCoordinates.clear();
+}
+
+std::vector<double> GCylinder::packedMeshCoordinates()
+{
+	// Green coordinates are not stored, they are recomputed
+	if(deformer != SKINNING || !skinner)
+		return std::vector<double>();
+
+	// Only valid while \gc is still the GC they were computed for, since
+	// loading takes the current \gc as the original one
+	const GeneralizedCylinder & origGC = skinner->originalGC();
+
+	if(gc->crossSection.size() != origGC.crossSection.size())
+		return std::vector<double>();
+
+	for(int i = 0; i < (int)gc->crossSection.size(); i++)
+	{
+		const GeneralizedCylinder::Circle & c = gc->crossSection[i], & o = origGC.crossSection[i];
+
+		if(!(c.center == o.center) || !(c.n == o.n) || c.radius != o.radius)
+			return std::vector<double>();
+	}
+
+	return skinner->packedCoordinates();
 }
 
 void GCylinder::deformMesh()
@@ -99,6 +129,9 @@ void GCylinder::deformMesh()
 		skinner->deform();
 
 	m_mesh->computeBoundingBox();
+
+	isDirty = false;
+	numDeformations++;
 }
 
 void GCylinder::draw()
@@ -436,6 +469,13 @@ void* GCylinder::getState()
 }
 
 void GCylinder::setState( void* toState)
+{
+	applyState(toState);
+
+	if(isDirty) deformMesh();
+}
+
+void GCylinder::applyState( void* toState)
 {
 	std::vector<double> & state = *(std::vector<double> *)toState;
 
@@ -448,8 +488,11 @@ void GCylinder::setState( void* toState)
 		curveScales[k] = state[i++]; // S
 	}
 
-	// Update the GC, cage, and mesh
-	update();
+	// Update the GC and cage, the mesh follows on \deformMesh
+	updateGC();
+	updateCage();
+
+	isDirty = true;
 }
 
 void GCylinder::serialize( QTextStream &out)
@@ -667,7 +710,7 @@ void GCylinder::movePoint( Point p, Vec3d T )
 	}
 }
 
-void GCylinder::save( std::ofstream &outF )
+void GCylinder::save( std::ostream &outF )
 {
 	outF << this->cageScale << '\t';
 	outF << this->cageSides << '\t';
@@ -687,7 +730,7 @@ void GCylinder::save( std::ofstream &outF )
 	}
 }
 
-void GCylinder::load( std::ifstream &inF, Vec3d translation, double scaleFactor )
+void GCylinder::load( std::istream &inF, Vec3d translation, double scaleFactor )
 {
 	inF >> this->cageScale;
 	inF >> this->cageSides;
@@ -833,7 +876,7 @@ void GCylinder::update()
 {
 	updateGC();
 	updateCage();
-	deformMesh();
+	requestDeformation();
 }
 
 Point GCylinder::closestProjection( Point p )
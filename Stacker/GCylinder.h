@@ -25,6 +25,7 @@ public:
 									// Build GC from spin points
 	void buildCage();				// Build the cage from the skeleton for the first time
 	void computeMeshCoordinates();	// Set up the underlying deformer
+	std::vector<double> packedMeshCoordinates();
 	void buildUp();				// Include the two step above
 
 	// Update
@@ -77,6 +78,7 @@ public:
 	// Primitive state
 	void*	getState();
 	void	setState( void* toState);
+	void	applyState( void* toState);
 
 	// Symmetry
 	void	setSymmetryPlanes(int nb_fold);
@@ -85,8 +87,8 @@ public:
 	Point	getSelectedCurveCenter();
 	
 	// Save and load
-	void save(std::ofstream &outF);
-	void load(std::ifstream &inF, Vec3d translation, double scaleFactor);
+	void save(std::ostream &outF);
+	void load(std::istream &inF, Vec3d translation, double scaleFactor);
 	void	serialize( QTextStream &out);
 	void	unserialize( QTextStream &in);
 public:
@@ -14,12 +14,12 @@ void Group::process( QVector< Primitive* > segments )
 	nodes = segments;
 }
 
-void Group::loadParameters( std::ifstream &inF, Vec3d translation, double scaleFactor )
+void Group::loadParameters( std::istream &inF, Vec3d translation, double scaleFactor )
 {
 	// Please reload this method if there are parameters to load
 }
 
-void Group::saveParameters( std::ofstream &outF )
+void Group::saveParameters( std::ostream &outF )
 {
 	// Please reload this method if there are parameters to save
 }
@@ -28,8 +28,8 @@ public:
 	void drawDebug();
 
 	// Group specified parameters
-	virtual void saveParameters(std::ofstream &outF);
-	virtual void loadParameters(std::ifstream &inF, Vec3d translation, double scaleFactor);
+	virtual void saveParameters(std::ostream &outF);
+	virtual void loadParameters(std::istream &inF, Vec3d translation, double scaleFactor);
 
 	// Others
 	bool has(QString id);
@@ -3,6 +3,8 @@
 #include "HiddenViewer.h"
 #include "Numeric.h"
 
+#include <Eigen/LU>
+
 HiddenViewer::HiddenViewer( QWidget * parent ) : QGLViewer (parent)
 {
 	// Restrict the size of the window
@@ -14,6 +16,10 @@ HiddenViewer::HiddenViewer( QWidget * parent ) : QGLViewer (parent)
 	// Initial render mode as HV_NONE
 	mode = HV_NONE;
 
+	// Culling is set up by \updateBVH()
+	bvhObject = NULL;
+	isCulling = false;
+
 	// Avoid camera bug
 	objectTransformation.t = Vec(0,0,0);
 	objectTransformation.rot = Quaternion();
@@ -108,13 +114,19 @@ void HiddenViewer::draw()
 //		std::cout << "Hidden Viewer: DEPTH\n";
 		glClearColor(0,0,0,0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		activeObject()->simpleDraw();
+		if (isCulling && bvhObject == activeObject())
+			drawCulled(false);
+		else
+			activeObject()->simpleDraw();
 		break;
 	case HV_FACEUNIQUE:
 //		std::cout << "Hidden Viewer: FACEUNIQUE\n";
 		glClearColor(0,0,0,0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		activeObject()->drawFacesUnique();
+		if (isCulling && bvhObject == activeObject())
+			drawCulled(true);
+		else
+			activeObject()->drawFacesUnique();
 		break;
 	}
 
@@ -131,6 +143,7 @@ QSegMesh* HiddenViewer::activeObject()
 void HiddenViewer::setActiveObject( QSegMesh * changedObject )
 {
 	_activeObject = changedObject;
+	bvhObject = NULL;
 	this->updateGL();
 }
 
@@ -166,3 +179,133 @@ void HiddenViewer::setResolution( int newRes )
 {
 	setFixedSize(newRes,newRes);
 }
+
+CameraMatrices HiddenViewer::cameraMatrices()
+{
+	GLdouble modelView[16], projection[16];
+	camera()->getModelViewMatrix(modelView);
+	camera()->getProjectionMatrix(projection);
+
+	Eigen::Matrix4d mv = Eigen::Map<Eigen::Matrix4d>(modelView);
+	Eigen::Matrix4d pr = Eigen::Map<Eigen::Matrix4d>(projection);
+	Eigen::Matrix4d mvp = pr * mv;
+	Eigen::Matrix4d inverseMvp = mvp.inverse();
+
+	CameraMatrices cm;
+	Eigen::Map<Eigen::Matrix4d>(cm.mvp) = mvp;
+	Eigen::Map<Eigen::Matrix4d>(cm.inverseMvp) = inverseMvp;
+	cm.width = width();
+	cm.height = height();
+
+	return cm;
+}
+
+// Same as gluProject and gluUnProject with the viewport of qglviewer::Camera
+Vec3d CameraMatrices::project( const Vec3d& p ) const
+{
+	const double *m = mvp;
+	double x = m[0]*p[0] + m[4]*p[1] + m[8]*p[2] + m[12];
+	double y = m[1]*p[0] + m[5]*p[1] + m[9]*p[2] + m[13];
+	double z = m[2]*p[0] + m[6]*p[1] + m[10]*p[2] + m[14];
+	double w = m[3]*p[0] + m[7]*p[1] + m[11]*p[2] + m[15];
+
+	x /= w; y /= w; z /= w;
+
+	return Vec3d(width * (x + 1) / 2, height * (1 - y) / 2, (z + 1) / 2);
+}
+
+Vec3d CameraMatrices::unproject( double x, double y, double z ) const
+{
+	double nx = 2 * x / width - 1;
+	double ny = 1 - 2 * y / height;
+	double nz = 2 * z - 1;
+
+	const double *m = inverseMvp;
+	double px = m[0]*nx + m[4]*ny + m[8]*nz + m[12];
+	double py = m[1]*nx + m[5]*ny + m[9]*nz + m[13];
+	double pz = m[2]*nx + m[6]*ny + m[10]*nz + m[14];
+	double pw = m[3]*nx + m[7]*ny + m[11]*nz + m[15];
+
+	return Vec3d(px / pw, py / pw, pz / pw);
+}
+
+// Boxes against the view volume, in normalized device coordinates
+struct FrustumOverlap{
+	double m[16];		// Projection * model view, column major
+
+	int operator()(const Vec3d& bbmin, const Vec3d& bbmax) const
+	{
+		double xmin = DBL_MAX, xmax = -DBL_MAX, ymin = DBL_MAX, ymax = -DBL_MAX;
+
+		for (int i = 0; i < 8; i++)
+		{
+			double px = (i & 1) ? bbmax[0] : bbmin[0];
+			double py = (i & 2) ? bbmax[1] : bbmin[1];
+			double pz = (i & 4) ? bbmax[2] : bbmin[2];
+
+			double w = m[3]*px + m[7]*py + m[11]*pz + m[15];
+			double x = (m[0]*px + m[4]*py + m[8]*pz + m[12]) / w;
+			double y = (m[1]*px + m[5]*py + m[9]*pz + m[13]) / w;
+
+			xmin = Min(xmin, x); xmax = Max(xmax, x);
+			ymin = Min(ymin, y); ymax = Max(ymax, y);
+		}
+
+		if (xmax < -1 || xmin > 1 || ymax < -1 || ymin > 1) return 0;
+		if (xmin >= -1 && xmax <= 1 && ymin >= -1 && ymax <= 1) return 2;
+		return 1;
+	}
+};
+
+void HiddenViewer::updateBVH()
+{
+	if (!activeObject()) return;
+
+	int N = activeObject()->nbSegments();
+
+	// Same topology, only vertices moved
+	bool isSameTopology = (bvhObject == activeObject() && (int)segmentBVH.size() == N);
+	for (int i = 0; isSameTopology && i < N; i++)
+		isSameTopology = (segmentBVH[i].mesh == activeObject()->getSegment(i)
+			&& segmentBVH[i].numFaces() == (int)activeObject()->getSegment(i)->n_faces());
+
+	segmentBVH.resize(N);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < N; i++)
+	{
+		if (isSameTopology)
+			segmentBVH[i].refit();
+		else
+			segmentBVH[i].build(activeObject()->getSegment(i));
+	}
+
+	bvhObject = activeObject();
+}
+
+void HiddenViewer::drawCulled( bool isFaceUnique )
+{
+	// The object placement is already on the model view matrix
+	GLdouble modelView[16], projection[16];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+
+	FrustumOverlap overlap;
+	Eigen::Map<Eigen::Matrix4d>(overlap.m) = Eigen::Map<Eigen::Matrix4d>(projection) * Eigen::Map<Eigen::Matrix4d>(modelView);
+
+	uint offset = 0;
+	for (int i = 0; i < (int)segmentBVH.size(); i++)
+	{
+		QSurfaceMesh * seg = activeObject()->getSegment(i);
+
+		std::vector<uint> faces;
+		segmentBVH[i].collect(overlap, faces);
+
+		if (isFaceUnique)
+			seg->drawFacesUnique(offset, faces);
+		else
+			seg->simpleDraw(faces);
+
+		offset += seg->n_faces();
+	}
+}
@@ -4,6 +4,7 @@
 using namespace qglviewer;
 
 #include "GraphicsLibrary/Mesh/SurfaceMesh/Vector.h"
+#include "GraphicsLibrary/SpacePartition/BVH.h"
 
 enum HVMode { HV_NONE, HV_DEPTH, HV_FACEUNIQUE };
 
@@ -16,6 +17,17 @@ struct ObjectTranformation{
 	Vec3d bbmax;
 };
 
+// Camera of one render, so that (un)projections need no re-rendering
+struct CameraMatrices{
+	double mvp[16];			// Projection * model view, column major as in OpenGL
+	double inverseMvp[16];
+	int width, height;
+
+	// Window coordinates are in the Qt format, (0, 0) being at the top left conner
+	Vec3d project(const Vec3d& p) const;
+	Vec3d unproject(double x, double y, double z) const;
+};
+
 class HiddenViewer : public QGLViewer
 {
 	Q_OBJECT
@@ -26,6 +38,11 @@ private:
 	HVMode mode;
 	int size;
 
+	// Per segment hierarchies for culling zoomed in renders
+	std::vector<BVH> segmentBVH;
+	QSegMesh * bvhObject;
+	void drawCulled(bool isFaceUnique);
+
 public:
 	HiddenViewer(QWidget * parent = 0);
 
@@ -40,6 +57,11 @@ public:
 	QSegMesh* activeObject();
 
 	void* readBuffer( GLenum format, GLenum type );
+	CameraMatrices cameraMatrices();
+
+	// Culling
+	void updateBVH();			// Build for a new topology, refit otherwise
+	bool isCulling;				// Only submit the faces inside the view frustum
 
 	ObjectTranformation objectTransformation;
 
@@ -15,6 +15,12 @@ Improver::Improver( Offset *offset )
 	BB_TOLERANCE = 1.2;
 	TARGET_STACKABILITY = 0.4;
 	LOCAL_RADIUS = 1;
+	LEAST_SQUARES_JOINTS = false;
+	PROXY_PREFILTER = false;
+	PROXY_MARGIN = 0.1;
+
+	numRounds = numEvaluations = numProxyRejections = numProxySamples = numAvoidedRenders = 0;
+	proxyError = proxyMaxError = 0;
 }
 
 QSegMesh* Improver::activeObject()
@@ -52,7 +58,7 @@ bool Improver::satisfyBBConstraint()
 	bool result = true;
 
 	Vec3d preBB = constraint_bbmax - constraint_bbmin;
-	activeObject()->computeBoundingBox();
+	ctrl()->deformDirtyPrimitives();
 	Vec3d currBB = activeObject()->bbmax - activeObject()->bbmin;
 
 	Vec3d diff = preBB - currBB;
@@ -118,9 +124,30 @@ void Improver::setPositionalConstriants( HotSpot& fixedHS )
 
 void Improver::recordSolution(Point handleCenter, Vec3d localMove)
 {
+	// The proxies are scored before any mesh is deformed
+	double proxyStackability = 0;
+	if (PROXY_PREFILTER)
+	{
+		proxyStackability = activeOffset->computeProxyStackability();
+		if (proxyStackability - origProxyStackability < -PROXY_MARGIN)
+		{
+			numProxyRejections++;
+			return;
+		}
+	}
+
 	activeOffset->computeStackability();
+	numEvaluations++;
 	double stackability = activeObject()->val["stackability"];
 
+	// Running mean of the proxy error
+	if (PROXY_PREFILTER)
+	{
+		numProxySamples++;
+		proxyError += (fabs(proxyStackability - stackability) - proxyError) / numProxySamples;
+		proxyMaxError = Max(proxyMaxError, fabs(proxyStackability - stackability));
+	}
+
 	ShapeState state = ctrl()->getShapeState();
 
 	// \state has to be unique
@@ -238,6 +265,7 @@ void Improver::deformNearPointLineHotspot( int side )
 
 	// Move the hotspot locally
 	Propagator propagator(ctrl());
+	propagator.isUsingLeastSquares = LEAST_SQUARES_JOINTS;
 	QVector<Vec3d> Ts = getLocalMoves(freeHS);
 
 	//// debug
@@ -275,6 +303,8 @@ void Improver::deformNearPointLineHotspot( int side )
 		// Restore the shape state of current candidate
 		ctrl()->setShapeState(currentCandidate);
 	}
+
+	numRounds += propagator.numRounds;
 }
 
 void Improver::deformNearRingHotspot( int side )
@@ -289,6 +319,7 @@ void Improver::deformNearRingHotspot( int side )
 
 	// Scale the ring hot spot
 	Propagator propagator(ctrl());
+	propagator.isUsingLeastSquares = LEAST_SQUARES_JOINTS;
 	QVector<double> scales = getLocalScales(freeHS);
 
 	// debug
@@ -323,6 +354,8 @@ void Improver::deformNearRingHotspot( int side )
 		// Restore the shape state of current candidate
 		ctrl()->setShapeState(currentCandidate);
 	}
+
+	numRounds += propagator.numRounds;
 }
 
 void Improver::deformNearHotspot( int side )
@@ -353,12 +386,30 @@ void Improver::execute(int level)
 
 	// The original stackability
 	origStackability = activeOffset->computeStackability();
+	numRounds = 0;
+	numEvaluations = 1;
+	numProxyRejections = 0;
+	numProxySamples = 0;
+	numAvoidedRenders = 0;
+	proxyError = proxyMaxError = 0;
+
+	// Proxies are rasterized over the whole cone, only worth it for the prefilter
+	if (PROXY_PREFILTER)
+	{
+		origProxyStackability = activeOffset->computeProxyStackability();
+		numProxySamples = 1;
+		proxyError = proxyMaxError = fabs(origProxyStackability - origStackability);
+	}
 
 	// Push the current shape as the initial candidate solution
 	ShapeState origState = ctrl()->getShapeState();
 	candidateSolutions.push(origState);
 	double currentStackability = 0;
 
+	// Meshes are deformed only when the offset is sampled
+	ctrl()->resetDeformationCount();
+	ctrl()->setDeferredDeformation(true);
+
 // Timer
 timer.restart();
 	while( ( level>0 || level==IMPROVER_MAGIC_NUMBER )	// Suggest || Improve
@@ -369,6 +420,7 @@ timer.restart();
 		candidateSolutions.pop();
 		ctrl()->setShapeState(currentCandidate);
 		currentStackability = activeOffset->computeStackability();
+		numEvaluations++;
 
 		std::cout << "CurrStackability = " << currentStackability << "\n";
 
@@ -385,6 +437,7 @@ timer.restart();
 
 		// Detect hot spots
 		activeOffset->detectHotspots();
+		numAvoidedRenders += activeOffset->numAvoidedRenders;
 		if (activeOffset->upperHotSpots.empty() || activeOffset->lowerHotSpots.empty())
 			std::cout << "\nWARNING: Hot spot detection failed.\n";
 
@@ -404,6 +457,14 @@ std::cout << "Total time = " <<(double)timer.elapsed()/60000 << " min\n";
 
 	// Restore the original
 	ctrl()->setShapeState(origState);
+	ctrl()->setDeferredDeformation(false);
+	std::cout << "Mesh deformations = " << ctrl()->numDeformations() << "\n";
+	std::cout << "Propagation rounds = " << numRounds << ", evaluations = " << numEvaluations
+		<< (LEAST_SQUARES_JOINTS ? " (least-squares joints)\n" : "\n");
+	std::cout << "Avoided re-renders = " << numAvoidedRenders << "\n";
+	if (PROXY_PREFILTER)
+		std::cout << "Proxy rejections = " << numProxyRejections << ", proxy error = " << proxyError
+			<< " (worst " << proxyMaxError << ")\n";
 	std::cout << "Searching completed.\n" << std::endl;
 }
 
@@ -24,6 +24,9 @@ public:
 	double BB_TOLERANCE;
 	double TARGET_STACKABILITY;
 	int LOCAL_RADIUS;
+	bool LEAST_SQUARES_JOINTS;		// Solve multi-joint cuboids in one step
+	bool PROXY_PREFILTER;			// Drop candidates whose proxy stackability drops by more than PROXY_MARGIN
+	double PROXY_MARGIN;
 
 	// Execute improving
 	void execute(int level = IMPROVER_MAGIC_NUMBER);
@@ -43,12 +46,22 @@ private:
 public:
 	// Best first Searching
 	double origStackability;
+	double origProxyStackability;
 	Vec3d constraint_bbmin, constraint_bbmax;
 	ShapeState currentCandidate;
 	PQShapeStateLessEnergy candidateSolutions;
 	QVector<ShapeState> usedCandidateSolutions;
 	QVector<ShapeState> solutions;
 
+	// Statistics of the last \execute
+	int numRounds;			// Propagation rounds
+	int numEvaluations;		// Stackability evaluations
+	int numProxyRejections;	// Candidates dropped by the proxy prefilter
+	double proxyError;		// Mean |proxy - mesh| stackability over \numProxySamples shapes
+	double proxyMaxError;	// Worst of the same
+	int numProxySamples;
+	int numAvoidedRenders;	// Calls to updateGL() saved by the cached camera matrices
+
 private:
 	Offset* activeOffset;
 	QSegMesh* activeObject();
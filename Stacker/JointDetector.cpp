@@ -22,49 +22,122 @@ JointDetector::JointDetector()
 QVector<Group*> JointDetector::detect( QVector<Primitive*> primitives )
 {
 	QVector<Group*> Joints;
-	std::vector<Voxeler> voxels;
+	int N = primitives.size();
 
+	// Proxy geometry
+	std::vector<QSurfaceMesh> meshes;
+	meshes.reserve(N);
 	foreach(Primitive * prim, primitives)
 	{
-		QSurfaceMesh mesh(prim->getGeometry());
-		voxels.push_back( Voxeler(&mesh, JOINT_THRESHOLD) );
+		meshes.push_back(prim->getGeometry());
+		meshes.back().computeBoundingBox();
 	}
 
-	for(uint i = 0; i < primitives.size(); i++)
-	{
-		Primitive * a = primitives[i];
+	// Broad phase: only pairs with overlapping voxel ranges can intersect
+	std::vector< std::pair<int,int> > pairs = overlappingPairs(meshes);
+	int P = pairs.size();
 
-		for (uint j = i + 1; j < primitives.size(); j++)
-		{
-			Primitive * b = primitives[j];
+	// Voxelize only the primitives that are part of some pair
+	std::vector<Voxeler*> voxels(N, (Voxeler*)NULL);
+	std::vector<bool> isNeeded(N, false);
+	for (int k = 0; k < P; k++)
+		isNeeded[pairs[k].first] = isNeeded[pairs[k].second] = true;
 
-			std::vector<Voxel> intersection = voxels[i].Intersects(&voxels[j]);
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < N; i++)
+	{
+		if (isNeeded[i])
+			voxels[i] = new Voxeler(&meshes[i], JOINT_THRESHOLD);
+	}
 
-			if(!intersection.empty())
-			{
-				// Voxel positions
-				std::vector<Point> points;
-				foreach( Voxel v, intersection){
-					points.push_back(Point(v.x, v.y, v.z) * JOINT_THRESHOLD);
-				}
+	// Narrow phase, results are merged in pair order below
+	std::vector< QVector<Group*> > pairwiseJoints(P);
 
-				//// Debug: visualize the intersection
-				//foreach (Point p, points)
-				//	a->debugPoints.push_back(p);
+	#pragma omp parallel for schedule(dynamic)
+	for (int k = 0; k < P; k++)
+	{
+		int i = pairs[k].first, j = pairs[k].second;
 
-				// Analyze the pair-wise intersection
-				QVector<Group*> pairwiseJoints = analyzeIntersection(a, b, points);
+		std::vector<Voxel> intersection = voxels[i]->Intersects(voxels[j]);
 
-				foreach(Group* g, pairwiseJoints)
-					Joints.push_back(g);
+		if(!intersection.empty())
+		{
+			// Voxel positions
+			std::vector<Point> points;
+			foreach( Voxel v, intersection){
+				points.push_back(Point(v.x, v.y, v.z) * JOINT_THRESHOLD);
 			}
 
+			//// Debug: visualize the intersection
+			//foreach (Point p, points)
+			//	a->debugPoints.push_back(p);
+
+			// Analyze the pair-wise intersection
+			pairwiseJoints[k] = analyzeIntersection(primitives[i], primitives[j], points);
 		}
 	}
 
+	for (int k = 0; k < P; k++)
+	{
+		foreach(Group* g, pairwiseJoints[k])
+			Joints.push_back(g);
+	}
+
+	for (int i = 0; i < N; i++)
+		delete voxels[i];
+
 	return Joints;
 }
 
+// Sweep and prune on the voxel index ranges, which are the face bounds used by \Voxeler
+std::vector< std::pair<int,int> > JointDetector::overlappingPairs( std::vector<QSurfaceMesh> & meshes )
+{
+	int N = meshes.size();
+	std::vector< std::pair<int,int> > pairs;
+
+	std::vector<Vec3i> lo(N), hi(N);
+	std::vector< std::pair<int,int> > order;	// (min x, index)
+
+	for (int i = 0; i < N; i++)
+	{
+		for (int d = 0; d < 3; d++)
+		{
+			lo[i][d] = (int)floor(meshes[i].bbmin[d] / JOINT_THRESHOLD);
+			hi[i][d] = (int)ceil(meshes[i].bbmax[d] / JOINT_THRESHOLD);
+		}
+
+		order.push_back(std::make_pair(lo[i][0], i));
+	}
+
+	std::sort(order.begin(), order.end());
+
+	std::vector<int> active;
+	for (int s = 0; s < N; s++)
+	{
+		int j = order[s].second;
+
+		// Drop the ones that ended before \j starts along x
+		std::vector<int> stillActive;
+		foreach(int i, active)
+			if (hi[i][0] >= lo[j][0]) stillActive.push_back(i);
+		active = stillActive;
+
+		foreach(int i, active)
+		{
+			if (lo[i][1] <= hi[j][1] && lo[j][1] <= hi[i][1] 
+				&& lo[i][2] <= hi[j][2] && lo[j][2] <= hi[i][2])
+				pairs.push_back(std::make_pair(Min(i, j), Max(i, j)));
+		}
+
+		active.push_back(j);
+	}
+
+	// Same order as testing every (i, j) with i < j
+	std::sort(pairs.begin(), pairs.end());
+
+	return pairs;
+}
+
 QVector<Group*> JointDetector::analyzeIntersection( Primitive* a, Primitive* b, std::vector<Point> &intersection )
 {
 	QVector<Group*> Joints;
@@ -93,8 +166,6 @@ QVector<Group*> JointDetector::analyzeIntersection( Primitive* a, Primitive* b,
 	//foo->debug_lines3.push_back(line2);
 
 	// Decide the type of joint
-	std::cout << box.Extent[2]/box.Extent[1] << std::endl;
-	
 	if (box.Extent[2]/box.Extent[1] < POINT_LINE_THRESHOLD)
 	{
 		// Point-joint
@@ -122,8 +193,6 @@ QVector<Group*> JointDetector::analyzeIntersection( Primitive* a, Primitive* b,
 		// The distance between two clusters
 		double dis = distanceCluster2Cluster(clusters[0], clusters[1]);
 
-		std::cout << dis/box.Extent[2] << std::endl;
-
 		if (dis/box.Extent[2] < LINE_2PONINTS_THRESHOLD)
 		{
 			// Line-joint
@@ -19,6 +19,7 @@ public:
 	QVector<Group*> detect( QVector<Primitive*> primitives );
 
 private:
+	std::vector< std::pair<int,int> > overlappingPairs( std::vector<QSurfaceMesh> & meshes );
 	PointJointGroup* setupPointJointGroup( QVector<Primitive*> segments, std::vector<Point>& points );
 	QVector<Group*> analyzeIntersection( Primitive* a, Primitive* b, std::vector<Point> &intersection );
 public:
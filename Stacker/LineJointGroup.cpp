@@ -75,13 +75,13 @@ void LineJointGroup::draw()
 
 }
 
-void LineJointGroup::saveParameters( std::ofstream &outF )
+void LineJointGroup::saveParameters( std::ostream &outF )
 {
 	updateLineEnds();
 	outF << lineEnds[0] << '\t' << lineEnds[1];
 }
 
-void LineJointGroup::loadParameters( std::ifstream &inF, Vec3d translation, double scaleFactor )
+void LineJointGroup::loadParameters( std::istream &inF, Vec3d translation, double scaleFactor )
 {
 	lineEnds.resize(2);
 	inF >> lineEnds[0] >> lineEnds[1];
@@ -6,6 +6,8 @@
 #include <QImage>
 #include <QFile>
 #include <stack>
+#include <algorithm>
+#include <cfloat>
 
 double GC_GAUSSIAN_SIGMA = 0.2;
 
@@ -33,6 +35,138 @@ double getMinValue( Buffer2d& image )
 	return MinElement(row_min);
 }
 
+// Pyramid
+void MinMaxPyramid::build( Buffer2d& image )
+{
+	maxLevels.clear();
+	minLevels.clear();
+	if (image.empty() || image[0].empty()) return;
+
+	maxLevels.push_back(image);
+	minLevels.push_back(image);
+
+	// Halve until a single tile is left
+	while (maxLevels.back().size() > 1 || maxLevels.back()[0].size() > 1)
+	{
+		const Buffer2d &fineMax = maxLevels.back();
+		const Buffer2d &fineMin = minLevels.back();
+		int h = fineMax.size(), w = fineMax[0].size();
+		int ch = (h + 1) / 2, cw = (w + 1) / 2;
+
+		Buffer2d coarseMax(ch, std::vector<double>(cw));
+		Buffer2d coarseMin(ch, std::vector<double>(cw));
+
+		#pragma omp parallel for if(ch > 64)
+		for (int y = 0; y < ch; y++){
+			for (int x = 0; x < cw; x++)
+			{
+				int x1 = Min(2*x + 1, w-1), y1 = Min(2*y + 1, h-1);
+				coarseMax[y][x] = Max(Max(fineMax[2*y][2*x], fineMax[2*y][x1]), Max(fineMax[y1][2*x], fineMax[y1][x1]));
+				coarseMin[y][x] = Min(Min(fineMin[2*y][2*x], fineMin[2*y][x1]), Min(fineMin[y1][2*x], fineMin[y1][x1]));
+			}
+		}
+
+		maxLevels.push_back(coarseMax);
+		minLevels.push_back(coarseMin);
+	}
+}
+
+double MinMaxPyramid::maxInRect( int x0, int y0, int x1, int y1 ) const
+{
+	return extremumInRect(maxLevels, true, maxLevels.size() - 1, 0, 0, x0, y0, x1, y1);
+}
+
+double MinMaxPyramid::minInRect( int x0, int y0, int x1, int y1 ) const
+{
+	return extremumInRect(minLevels, false, minLevels.size() - 1, 0, 0, x0, y0, x1, y1);
+}
+
+// Tiles inside the rectangle are answered at their level, only the ones on its border are refined
+double MinMaxPyramid::extremumInRect( const std::vector<Buffer2d> & levels, bool isMax, int level, int tx, int ty,
+	int x0, int y0, int x1, int y1 ) const
+{
+	double none = isMax ? -DBL_MAX : DBL_MAX;
+
+	const Buffer2d &tiles = levels[level];
+	if (ty >= (int)tiles.size() || tx >= (int)tiles[0].size()) return none;
+
+	int size = 1 << level;
+	int tx0 = tx * size, ty0 = ty * size;
+	int tx1 = tx0 + size - 1, ty1 = ty0 + size - 1;
+
+	if (tx1 < x0 || tx0 > x1 || ty1 < y0 || ty0 > y1) return none;
+	if ((tx0 >= x0 && tx1 <= x1 && ty0 >= y0 && ty1 <= y1) || level == 0) return tiles[ty][tx];
+
+	double result = none;
+	for (int i = 0; i < 4; i++)
+	{
+		double v = extremumInRect(levels, isMax, level - 1, 2*tx + (i & 1), 2*ty + (i >> 1), x0, y0, x1, y1);
+		result = isMax ? Max(result, v) : Min(result, v);
+	}
+
+	return result;
+}
+
+// The \k largest local maxima, each refined by a quadratic fit on its 3x3 neighborhood
+// A fit is kept only if its peak lies within the pixel, steps in the offset are not extrapolated
+std::vector<Vec3d> refinedMaxima( Buffer2d& image, int k )
+{
+	std::vector<Vec3d> maxima;
+	int h = image.size();
+	if (h < 3) return maxima;
+	int w = image[0].size();
+
+	// Local maxima of the interior
+	std::vector< std::pair<double, int> > candidates;
+	for (int y = 1; y < h-1; y++){
+		for (int x = 1; x < w-1; x++)
+		{
+			double v = image[y][x];
+			if (v <= 0) continue;
+
+			bool isMax = true;
+			for (int dy = -1; dy <= 1 && isMax; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					if (image[y+dy][x+dx] > v) { isMax = false; break; }
+
+			if (isMax) candidates.push_back(std::make_pair(-v, y * w + x));
+		}
+	}
+
+	int K = Min(k, (int)candidates.size());
+	std::partial_sort(candidates.begin(), candidates.begin() + K, candidates.end());
+
+	for (int i = 0; i < K; i++)
+	{
+		int x = candidates[i].second % w;
+		int y = candidates[i].second / w;
+		double f0 = image[y][x];
+
+		// Gradient and Hessian by central differences
+		double gx = (image[y][x+1] - image[y][x-1]) / 2;
+		double gy = (image[y+1][x] - image[y-1][x]) / 2;
+		double hxx = image[y][x+1] - 2 * f0 + image[y][x-1];
+		double hyy = image[y+1][x] - 2 * f0 + image[y-1][x];
+		double hxy = (image[y+1][x+1] - image[y-1][x+1] - image[y+1][x-1] + image[y-1][x-1]) / 4;
+
+		Vec3d peak(x, y, f0);
+
+		double det = hxx * hyy - hxy * hxy;
+		if (hxx < 0 && det > 0)
+		{
+			double sx = -( hyy * gx - hxy * gy) / det;
+			double sy = -(-hxy * gx + hxx * gy) / det;
+
+			if (fabs(sx) <= 0.5 && fabs(sy) <= 0.5)
+				peak = Vec3d(x + sx, y + sy, f0 + 0.5 * (gx * sx + gy * sy));
+		}
+
+		maxima.push_back(peak);
+	}
+
+	return maxima;
+}
+
 // Regions
 double maxValueInRegion( Buffer2d& image,  std::vector< Vec2i >& region )
 {
@@ -161,7 +295,7 @@ std::vector< Vec2i > getRegionGreaterThan( Buffer2d& image, Buffer2b& mask, Vec2
 	return region;
 }
 
-std::vector< std::vector< Vec2i > > getRegionsGreaterThan( Buffer2d& image, double threshold )
+std::vector< std::vector< Vec2i > > getRegionsGreaterThan( Buffer2d& image, double threshold, const MinMaxPyramid * pyramid )
 {
 	std::vector< std::vector< Vec2i > > regions;
 
@@ -169,14 +303,27 @@ std::vector< std::vector< Vec2i > > getRegionsGreaterThan( Buffer2d& image, doub
 	int h = image.size();
 
 	std::vector< std::vector< bool > > mask = createImage(w, h, false);
+	std::vector< Vec2i > samples;
+	std::vector< int > cells;
+
+	// Seeds are searched in the same row-major order, skipping the tiles of the pyramid that are cold
+	const int L = 3, T = 1 << L;
+	bool isSkipping = pyramid && (int)pyramid->maxLevels.size() > L;
 
 	for(int y = 0; y < h; y++){
 		for(int x = 0; x < w; x++)	{
+			if (isSkipping && x % T == 0 && pyramid->maxLevels[L][y / T][x / T] <= threshold)
+			{
+				x += T - 1;
+				continue;
+			}
+
 			if (!mask[y][x] && image[y][x]>threshold)
 			{
 				//saveAsImage(mask, "mask1.png");
 				std::vector< Vec2i > region = getRegionGreaterThan(image, mask, Vec2i(x, y), threshold);
-				regions.push_back(sampleRegion(region, 100));
+				sampleRegion(region, 100, samples, cells);
+				regions.push_back(samples);
 				//regions.push_back(region);
 				//saveAsImage(mask, "mask2.png");
 			}
@@ -195,7 +342,8 @@ std::vector< std::vector< Vec2i > > getRegionsGreaterThan( Buffer2d& image, doub
 		}
 
 		regions.clear();
-		regions.push_back(sampleRegion(super_region, 100));
+		sampleRegion(super_region, 100, samples, cells);
+		regions.push_back(samples);
 		//regions.push_back(super_region);
 	}
 
@@ -288,7 +436,7 @@ QRgb jetColor( double val, double min, double max )
 
 
 // Visualize
-void visualizeRegions( int w, int h, std::vector< std::vector<Vec2i> >& regions, QString filename )
+Buffer2d regionsImage( int w, int h, std::vector< std::vector<Vec2i> >& regions )
 {
 	std::vector< std::vector< double > > debugImg = createImage(w, h, 0.0);
 	double step = 1.0 / regions.size();
@@ -296,6 +444,12 @@ void visualizeRegions( int w, int h, std::vector< std::vector<Vec2i> >& regions,
 	{
 		setRegionColor(debugImg, regions[i], step * (i+1));
 	}
+	return debugImg;
+}
+
+void visualizeRegions( int w, int h, std::vector< std::vector<Vec2i> >& regions, QString filename )
+{
+	Buffer2d debugImg = regionsImage(w, h, regions);
 	saveAsImage(debugImg, filename);
 }
 
@@ -364,31 +518,64 @@ void saveAsBinaryImage( Buffer2d& image, QString fileName )
 	Output.save(fileName);
 }
 
-std::vector<int> uniformIntegerSamples( int N, int range )
+// Grid stratified sampling: the bounding box of \region is cut into cells holding about
+// |region| / N pixels of the region each, at most N of them occupied,
+// and every occupied cell keeps the pixel closest to its center.
+// Deterministic, and \samples and \cells are reused without allocation once large enough
+void sampleRegion( const std::vector<Vec2i> &region, int N, std::vector<Vec2i> &samples, std::vector<int> &cells )
 {
-	N = Min(N, range);
+	samples.clear();
+	if ((int)region.size() <= N)
+	{
+		samples.insert(samples.end(), region.begin(), region.end());
+		return;
+	}
 
-	std::vector<int> results;
+	int minX = region[0].x(), maxX = minX, minY = region[0].y(), maxY = minY;
+	for (int i = 1; i < (int)region.size(); i++)
+	{
+		minX = Min(minX, region[i].x()); maxX = Max(maxX, region[i].x());
+		minY = Min(minY, region[i].y()); maxY = Max(maxY, region[i].y());
+	}
 
-	for (int i = 0; i < range; i++)
-		results.push_back(i);
+	// Thin regions occupy more cells than N, their cells are enlarged until they fit
+	double s = sqrt(double(region.size()) / N);
+	int nx, ny, occupied = N + 1;
 
-	// Shuffle
-	std::random_shuffle ( results.begin(), results.end() );
+	while (occupied > N)
+	{
+		nx = (int)((maxX - minX) / s) + 1;
+		ny = (int)((maxY - minY) / s) + 1;
 
-	return std::vector<int>(results.begin(), results.begin() + N);
-}
+		cells.assign(nx * ny, -1);
+		occupied = 0;
 
-std::vector<Vec2i> sampleRegion( std::vector<Vec2i> &region, int N )
-{
-	if(region.size() <= N) return region;
+		for (int i = 0; i < (int)region.size(); i++)
+		{
+			double fx = (region[i].x() - minX) / s;
+			double fy = (region[i].y() - minY) / s;
+			int cx = Min((int)fx, nx-1), cy = Min((int)fy, ny-1);
+			int c = cy * nx + cx;
 
-	std::vector<Vec2i> samples;
-	std::vector<int> sampleIdx = uniformIntegerSamples(N, region.size());
-	foreach(int i, sampleIdx)
-		samples.push_back(region[i]);
+			if (cells[c] < 0)
+			{
+				cells[c] = i;
+				occupied++;
+				continue;
+			}
 
-	return samples;
+			// Closest to the cell center, the first one on ties
+			double dx = fx - (cx + 0.5), dy = fy - (cy + 0.5);
+			const Vec2i &best = region[cells[c]];
+			double bx = (best.x() - minX) / s - (cx + 0.5), by = (best.y() - minY) / s - (cy + 0.5);
+			if (dx * dx + dy * dy < bx * bx + by * by) cells[c] = i;
+		}
+
+		s *= 1.01 * sqrt(double(occupied) / N);
+	}
+
+	for (int c = 0; c < (int)cells.size(); c++)
+		if (cells[c] >= 0) samples.push_back(region[cells[c]]);
 }
 
 
@@ -553,17 +740,17 @@ Vec3d maxMidMinValues( Buffer2d & image )
 	return Vec3d(0);
 }
 
-Buffer2v2i getMaximumRegions( Buffer2d &image )
+Buffer2v2i getMaximumRegions( Buffer2d &image, const MinMaxPyramid * pyramid )
 {
 	// Precondition: each pixel is greater or equal than 0
-	double maxV = getMaxValue(image);
+	double maxV = pyramid ? pyramid->maxValue() : getMaxValue(image);
 	Buffer2v2i regions;
 	double hot_cap = 1.0;
 
 	while (regions.empty())
 	{
 		hot_cap -= 0.05; // increase the cap
-		regions = getRegionsGreaterThan(image, maxV * hot_cap);
+		regions = getRegionsGreaterThan(image, maxV * hot_cap, pyramid);
 
 		// If the hot regions are too small
 		int num = 0;
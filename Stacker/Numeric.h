@@ -15,11 +15,36 @@ typedef std::vector< std::vector<Vec2i> >   Buffer2v2i;
 
 typedef Vec3d Point;
 
+// Min/max mip pyramid of an image, level l stores the extrema of 2^l x 2^l tiles
+class MinMaxPyramid
+{
+public:
+	void build( Buffer2d & image );
+	bool isEmpty() const { return maxLevels.empty(); }
+
+	double maxValue() const { return maxLevels.back()[0][0]; }
+	double minValue() const { return minLevels.back()[0][0]; }
+
+	// Extrema over the pixels [x0, x1] x [y0, y1]
+	double maxInRect( int x0, int y0, int x1, int y1 ) const;
+	double minInRect( int x0, int y0, int x1, int y1 ) const;
+
+	std::vector<Buffer2d> maxLevels;
+	std::vector<Buffer2d> minLevels;
+
+private:
+	double extremumInRect( const std::vector<Buffer2d> & levels, bool isMax, int level, int tx, int ty, 
+		int x0, int y0, int x1, int y1 ) const;
+};
+
 // Extrema
 double getMinValue( Buffer2d & image );
 double getMaxValue( Buffer2d & image );
 Vec3d maxMidMinValues( Buffer2d & image );
 
+// Sub-pixel extrema: (x, y, value) of local maxima refined by quadratic fits
+std::vector<Vec3d> refinedMaxima( Buffer2d & image, int k );
+
 // Region
 double maxValueInRegion( Buffer2d& image,  std::vector< Vec2i >& region);
 Vec2i sizeofRegion( std::vector< Vec2i >& region );
@@ -27,7 +52,7 @@ void BBofRegion( std::vector< Vec2i >& region, Vec2i &bbmin, Vec2i &bbmax );
 Vec2i centerOfRegion( std::vector< Vec2i >& region );
 std::vector< double > getValuesInRegion( Buffer2d& image, std::vector< Vec2i >& region, bool xFlipped = false );
 std::vector< Vec2i > getRegionGreaterThan( Buffer2d& image, Buffer2b& mask, Vec2i seed, double threshold);
-std::vector< std::vector< Vec2i > > getRegionsGreaterThan(Buffer2d& image, double threshold);
+std::vector< std::vector< Vec2i > > getRegionsGreaterThan(Buffer2d& image, double threshold, const MinMaxPyramid * pyramid = NULL);
 
 // Shifting
 std::vector< Vec2i > deltaVectorsToKRing(int deltaX, int deltaY, int K);
@@ -39,6 +64,7 @@ void setRegionColor( Buffer2d& image, std::vector< Vec2i >& region, double color
 void setPixelColor( Buffer2d& image, Vec2i pos, double color );
 
 // Visualization
+Buffer2d regionsImage( int w, int h, std::vector< std::vector<Vec2i> >& regions );
 void visualizeRegions( int w, int h, std::vector< std::vector<Vec2i> >& regions, QString filename );
 template< typename T >
 std::vector< std::vector < T > > createImage( int w, int h, T intial);
@@ -46,9 +72,8 @@ void saveAsBinaryImage( Buffer2d& image, QString fileName );
 void saveAsImage( Buffer2d& image, QString fileName );
 void saveAsData( Buffer2d& image, double maxV, QString fileName );
 
-// Random set of unique integers
-std::vector<int> uniformIntegerSamples(int N, int range);
-std::vector<Vec2i> sampleRegion(std::vector<Vec2i> &region, int N);
+// At most N evenly spread pixels of a region
+void sampleRegion(const std::vector<Vec2i> &region, int N, std::vector<Vec2i> &samples, std::vector<int> &cells);
 
 // Rotation
 Eigen::Matrix3d rotationMatrixAroundAxis(Vec3d u, double theta);
@@ -67,7 +92,7 @@ Point centroid(std::vector<Point> points);
 std::vector<Point> uniformSampleCurve(std::vector<Point> & points);
 
 // Adaptive maximum region detection
-Buffer2v2i getMaximumRegions(Buffer2d &image);
+Buffer2v2i getMaximumRegions(Buffer2d &image, const MinMaxPyramid * pyramid = NULL);
 
 // AABB
 std::vector<Point> cornersOfAABB(Vec3d bbmin, Vec3d bbmax);
@@ -2,6 +2,10 @@
 
 #include "Utility/ColorMap.h"
 #include "Utility/SimpleDraw.h"
+#include "Primitive.h"
+#include "SymmetryGroup.h"
+#include "Diagnostics.h"
+#include "GraphicsLibrary/SpacePartition/kdtree.h"
 #include <QFile>
 #include <numeric>
 #include "Numeric.h"
@@ -15,6 +19,7 @@ using namespace qglviewer;
 
 #define BIG_NUMBER 10
 #define DEPTH_EDGE_THRESHOLD 0.1
+#define SYMMETRY_SAMPLES 500
 
 
 Offset::Offset( HiddenViewer *viewer )
@@ -23,6 +28,15 @@ Offset::Offset( HiddenViewer *viewer )
 
 	searchDensity = 20;
 	searchType = NONE;
+
+	isUsingSymmetry = true;
+	numDirectionsEvaluated = 0;
+	isUsingRadialProfile = true;
+	profileBinWidth = 0;
+	stackingDirection = Vec3d(0, 0, 1);
+	proxyResolution = 64;
+	numAvoidedRenders = 0;
+	isSubPixelMax = true;
 }
 
 QSegMesh* Offset::activeObject()
@@ -95,6 +109,8 @@ void Offset::computeEnvelope(int side)
 	}
 
 	delete[] depthBuffer;
+
+	((1 == side)? upperPyramid : lowerPyramid).build(envelope);
 }
 
 void Offset::computeEnvelopeOfShape( int side, Vec3d up, Vec3d stacking_direction )
@@ -115,6 +131,7 @@ void Offset::computeEnvelopeOfShape( int side, Vec3d up, Vec3d stacking_directio
 	// Render
 	activeViewer->setMode(HV_DEPTH);
 	activeViewer->updateGL(); 
+	cameraMatrices[side+2] = activeViewer->cameraMatrices();
 
 	// compute the envelope
 	computeEnvelope(side);
@@ -137,9 +154,12 @@ void Offset::computeEnvelopeOfRegion( int side , Vec3d up, Vec3d direction, Vec3
 	// Save this new camera settings
 	objectTransformation[side+3] = activeViewer->objectTransformation;
 
-	// Render
+	// Render, the region only needs the faces in its view
 	activeViewer->setMode(HV_DEPTH);
+	activeViewer->isCulling = true;
 	activeViewer->updateGL(); 
+	activeViewer->isCulling = false;
+	cameraMatrices[side+3] = activeViewer->cameraMatrices();
 
 	// Compute
 	computeEnvelope(side);
@@ -165,6 +185,8 @@ void Offset::computeOffset()
 				offset[y][x] = upperEnvelope[y][x] - lowerEnvelope[y][(w-1)-x];
 		}
 	}
+
+	offsetPyramid.build(offset);
 }
 
 Vec3d Offset::computeCameraUpVector( Vec3d newZ )
@@ -210,10 +232,28 @@ void Offset::computeOffsetOfShape( Vec3d direction )
 }
 
 
+double Offset::maxOffset()
+{
+	double om = offsetPyramid.maxValue();
+
+	// Pixel maxima quantize with the resolution of the render
+	if (isSubPixelMax)
+	{
+		std::vector<Vec3d> maxima = refinedMaxima(offset, 8);
+		for (int i = 0; i < (int)maxima.size(); i++)
+			om = Max(om, maxima[i].z());
+	}
+
+	return om;
+}
+
 double Offset::computeStackability()
 {
 	if (!activeObject()) return -1;
 
+	// Deferred deformations are materialized here
+	if (ctrl()) ctrl()->deformDirtyPrimitives();
+
 	// The \V0
 	activeObject()->computeBoundingBox();
 	Vec3d diag = activeObject()->bbmax - activeObject()->bbmin;
@@ -224,13 +264,37 @@ double Offset::computeStackability()
 	Vec3d bestStackingDirection(0, 0, 1);
 	QVector<Vec3d> directions = getDirectionsInCone(coneSize);
 
-	foreach(Vec3d vec, directions)
+	// Directions mirrored by a symmetry of the shape share their stackability,
+	// only the representative of each orbit is evaluated
+	symmetryPlanes.clear();
+	if (isUsingSymmetry) symmetryPlanes = detectSymmetryPlanes();
+	QVector<int> representative = symmetryRepresentatives(directions, symmetryPlanes);
+	numDirectionsEvaluated = 0;
+
+	// Along the axis of a shape of revolution the offset only depends on the radius
+	bool isRadial = isUsingRadialProfile && isRotationallySymmetric();
+
+	for (int i = 0; i < (int)directions.size(); i++)
 	{
-		computeOffsetOfShape(vec);
+		if (representative[i] != i) continue;
+
+		Vec3d vec = directions[i];
+		numDirectionsEvaluated++;
 
 		// Compute stackability
-		double om = getMaxValue(offset);
-		Vec3d extent = computeShapeExtents(vec);
+		double om;
+		Vec3d extent;
+		if (isRadial && dot(vec.normalized(), Vec3d(0, 0, 1)) > 1 - ZERO_TOLERANCE)
+		{
+			om = computeRadialOffset();
+			extent = diag;
+		}
+		else
+		{
+			computeOffsetOfShape(vec);
+			om = maxOffset();
+			extent = computeShapeExtents(vec);
+		}
 		double V1 = volumeOfBB(extent);
 		double stackability = 1.0 - (om / extent[2]) * (V1 / V0);
 
@@ -245,6 +309,7 @@ double Offset::computeStackability()
 	// Save for \activeObject
 	activeObject()->val["stackability"] = maxStackability;
 	activeObject()->vec["stacking_shift"] = bestStackingDirection * O_max;
+	stackingDirection = bestStackingDirection;
 
 	//// Save offset as image
 	//saveAsImage(lowerDepth, "lower depth.png");
@@ -258,18 +323,31 @@ double Offset::computeStackability( Vec3d direction )
 {
 	if (!activeObject()) return -1;
 
+	// Deferred deformations are materialized here
+	if (ctrl()) ctrl()->deformDirtyPrimitives();
+
 	// The \V0
 	activeObject()->computeBoundingBox();
 	Vec3d diag = activeObject()->bbmax - activeObject()->bbmin;
 	double V0 = volumeOfBB(diag);
 
 	// Searching for the best stacking direction
-
-	computeOffsetOfShape(direction);
+	double om;
+	Vec3d extent;
+	if (isUsingRadialProfile && dot(direction.normalized(), Vec3d(0, 0, 1)) > 1 - ZERO_TOLERANCE
+		&& isRotationallySymmetric())
+	{
+		om = computeRadialOffset();
+		extent = diag;
+	}
+	else
+	{
+		computeOffsetOfShape(direction);
+		om = maxOffset();
+		extent = computeShapeExtents(direction);
+	}
 
 	// Compute stackability
-	double om = getMaxValue(offset);
-	Vec3d extent = computeShapeExtents(direction);
 	double V1 = volumeOfBB(extent);
 	double stackability = 1.0 - (om / extent[2]) * (V1 / V0);
 
@@ -277,6 +355,7 @@ double Offset::computeStackability( Vec3d direction )
 	// Save for \activeObject
 	activeObject()->val["stackability"] = stackability;
 	activeObject()->vec["stacking_shift"] = direction * O_max;
+	stackingDirection = direction;
 
 	//// Save offset as image
 	//saveAsImage(lowerDepth, "lower depth.png");
@@ -296,8 +375,12 @@ void Offset::computeOffsetOfRegion( Vec3d direction, std::vector< Vec2i >& regio
 	// Project BB of shape to 2D
 	Vec3d bbmin = activeObject()->bbmin;
 	Vec3d bbmax = activeObject()->bbmax;
-	Vec2i bbmin_shape = projectedCoordinatesOf(bbmin, 3);
-	Vec2i bbmax_shape = projectedCoordinatesOf(bbmax, 3);
+	std::vector<Vec3d> corners;
+	corners.push_back(bbmin);
+	corners.push_back(bbmax);
+	std::vector<Vec2i> corners_2D = projectedCoordinatesOf(corners, 3);
+	Vec2i bbmin_shape = corners_2D[0];
+	Vec2i bbmax_shape = corners_2D[1];
 
 	// Shrink the BB of shape along x and y direction to contain the \region only
 	Vec2i range_2D = bbmax_shape - bbmin_shape;
@@ -324,9 +407,9 @@ void Offset::computeOffsetOfRegion( Vec3d direction, std::vector< Vec2i >& regio
 	computeOffset();
 
 	// Save offset as image
-	saveAsImage(upperEnvelope, "upper.png");
-	saveAsImage(lowerEnvelope, "lower.png");
-	saveAsImage(offset, QString::number(direction.z()) + "_offset function of region.png");
+	Diagnostics::saveImage(DIAG_REGION_ENVELOPES, upperEnvelope, "upper.png");
+	Diagnostics::saveImage(DIAG_REGION_ENVELOPES, lowerEnvelope, "lower.png");
+	Diagnostics::saveImage(DIAG_REGION_OFFSET, offset, QString::number(direction.z()) + "_offset function of region.png");
 }
 
 double Offset::getStackability( bool recompute /*= false*/ )
@@ -342,10 +425,12 @@ HotSpot Offset::detectHotspotInRegion(int side, std::vector<Vec2i> &hotRegion)
 	activeViewer->objectTransformation = objectTransformation[side + 3];
 
 	// Draw Faces Unique
+	activeViewer->isCulling = true;
 	activeViewer->setMode(HV_FACEUNIQUE);
 	activeViewer->updateGL(); 
 	activeViewer->setMode(HV_FACEUNIQUE);
 	activeViewer->updateGL(); 
+	activeViewer->isCulling = false;
 
 	GLubyte* colormap = (GLubyte*)activeViewer->readBuffer(GL_RGBA, GL_UNSIGNED_BYTE);
 
@@ -360,12 +445,24 @@ HotSpot Offset::detectHotspotInRegion(int side, std::vector<Vec2i> &hotRegion)
 	// Detect hot spots
 	uint sid, fid, fid_local;
 	uint x, y;
+	uint nbFaces = activeObject()->nbFaces();
 
 	QMap< QString, int > subHotRegionSize;
 	QMap< QString, QVector< Vec2i > > subHotPixels;
 	QMap< QString, QVector< Vec3d > > subHotSamples;
 
 //	QImage debugImg(w, h, QImage::Format_ARGB32);
+
+	// 3d positions of all hot samples at once
+	// Flip \y to work in Qt format
+	std::vector<Vec3d> windowPoints(hotRegion.size());
+	for (int j=0;j<hotRegion.size();j++)
+	{
+		x = (side == 1) ? hotRegion[j].x() : (w-1) - hotRegion[j].x();
+		y = hotRegion[j].y();
+		windowPoints[j] = Vec3d(x, (h-1)-y, depth[y][x]);
+	}
+	std::vector<Vec3d> hotPs = unprojectedCoordinatesOf(windowPoints, side + 3);
 	
 	for (int j=0;j<hotRegion.size();j++)
 	{
@@ -374,11 +471,6 @@ HotSpot Offset::detectHotspotInRegion(int side, std::vector<Vec2i> &hotRegion)
 		x = (side == 1) ? hotPixel.x() : (w-1) - hotPixel.x();
 		y = hotPixel.y();
 
-		// 3d position of this hot sample
-		// Flip \y to work in Qt format
-		double depthVal = depth[y][x];
-		Vec hotP= activeViewer->camera()->unprojectedCoordinatesOf(Vec(x, (h-1)-y, depthVal));
-
 		// Get the face index and segment index back
 		uint indx = ((y*w)+x)*4;
 		uint r = (uint)colormap[indx+0];
@@ -388,14 +480,14 @@ HotSpot Offset::detectHotspotInRegion(int side, std::vector<Vec2i> &hotRegion)
 
 		fid = ((255-a)<<24) + (r<<16) + (g<<8) + b - 1;
 
-		if (fid >= activeObject()->nbFaces()) 
+		if (fid >= nbFaces) 
 			continue;
 
 		activeObject()->global2local_fid(fid, sid, fid_local);
 
 		// Store information for subHotRegion
 		QString segmentID = activeObject()->getSegment(sid)->objectName();
-		Vec3d hotPoint(hotP.x, hotP.y, hotP.z);
+		Vec3d hotPoint = hotPs[j];
 		subHotRegionSize[segmentID]++;
 		subHotPixels[segmentID].push_back(hotPixel);
 		subHotSamples[segmentID].push_back(hotPoint);
@@ -453,6 +545,7 @@ void Offset::detectHotspots( )
 {
 	// Initialization
 	clear();
+	numAvoidedRenders = 0;
 	int h = activeViewer->height();
 	int w = activeViewer->width();
 
@@ -460,9 +553,12 @@ void Offset::detectHotspots( )
 	Vec3d stackV = activeObject()->vec["stacking_shift"].normalized();
 	computeOffsetOfShape(stackV);
 
+	// The shape is fixed from now on, region renders are culled against it
+	activeViewer->updateBVH();
+
 	// Detect hot regions
-	hotRegions = getMaximumRegions(offset);
-	visualizeRegions(w, h, hotRegions, "hot regions of shape.png");
+	hotRegions = getMaximumRegions(offset, &offsetPyramid);
+	Diagnostics::saveRegions(DIAG_HOT_REGIONS, w, h, hotRegions, "hot regions of shape.png");
 
 	// The max offset of hot regions
 	maxOffsetInHotRegions.clear();
@@ -471,8 +567,8 @@ void Offset::detectHotspots( )
 	}
 
 	// The max of \UpperEnvelope and min of \LowerEnvelope
-	double maxUE = getMaxValue(upperEnvelope);
-	double minLE = getMinValue(lowerEnvelope);
+	double maxUE = upperPyramid.maxValue();
+	double minLE = lowerPyramid.minValue();
 
 	// Zoom into each hot region
 	for (int i=0;i<hotRegions.size();i++)
@@ -482,7 +578,7 @@ void Offset::detectHotspots( )
 		//saveAsImage(offset, "Offset of region before getting hot regions.png");
 
 		// Detect zoomed (in) hot region 
-		Buffer2v2i zoomedHRs = getMaximumRegions(offset);
+		Buffer2v2i zoomedHRs = getMaximumRegions(offset, &offsetPyramid);
 
 		// If there are multiple regions, pick up the one closest to the center
 		//visualizeRegions(w, h, zoomedHRs, QString::number(i) + "_zoomed in hot regions.png");
@@ -512,10 +608,24 @@ void Offset::detectHotspots( )
 		UHS.hotRegionID = i;
 		LHS.hotRegionID = i;
 
-		std::vector< double > valuesU = getValuesInRegion(upperEnvelope, zoomedHR, false);
-		UHS.defineHeight = MaxElement(valuesU) > (maxUE - ZERO_TOLERANCE);
-		std::vector< double > valuesL = getValuesInRegion(lowerEnvelope, zoomedHR, true);
-		LHS.defineHeight = MinElement(valuesL) < (minLE + ZERO_TOLERANCE);
+		// The bounding box of the region rejects most regions without reading their pixels
+		Vec2i hr_min, hr_max;
+		BBofRegion(zoomedHR, hr_min, hr_max);
+		int w_flip = (w-1);
+
+		UHS.defineHeight = false;
+		if (upperPyramid.maxInRect(hr_min.x(), hr_min.y(), hr_max.x(), hr_max.y()) > (maxUE - ZERO_TOLERANCE))
+		{
+			std::vector< double > valuesU = getValuesInRegion(upperEnvelope, zoomedHR, false);
+			UHS.defineHeight = MaxElement(valuesU) > (maxUE - ZERO_TOLERANCE);
+		}
+
+		LHS.defineHeight = false;
+		if (lowerPyramid.minInRect(w_flip - hr_max.x(), hr_min.y(), w_flip - hr_min.x(), hr_max.y()) < (minLE + ZERO_TOLERANCE))
+		{
+			std::vector< double > valuesL = getValuesInRegion(lowerEnvelope, zoomedHR, true);
+			LHS.defineHeight = MinElement(valuesL) < (minLE + ZERO_TOLERANCE);
+		}
 
 		UHS.decideType(ctrl());
 		LHS.decideType(ctrl());
@@ -608,37 +718,58 @@ void Offset::saveHotSpots( QString filename, int direction, double percent)
 
 
 // ==(un)Projection
+// The camera matrices captured with the envelopes are used, no re-rendering is needed
 Vec3d Offset::unprojectedCoordinatesOf( uint x, uint y, int side )
 {
-	// Restore the camera according to the direction
-	activeViewer->objectTransformation = objectTransformation[side + 2];
-	activeViewer->updateGL();
-
-	int w = activeViewer->height();
-	int h = activeViewer->width();
-
 	std::vector< std::vector<double> > &depth = (side == 1)? upperDepth : lowerDepth;
-	if (side == -1)	x = (w-1) - x;
+	int w = depth[0].size();
+	int h = depth.size();
 
-	Vec P = activeViewer->camera()->unprojectedCoordinatesOf(Vec(x, (h-1)-y, depth[y][x]));
+	if (side == -1)	x = (w-1) - x;
 
-	return Vec3d(P[0], P[1], P[2]);
+	std::vector<Vec3d> windowPoint(1, Vec3d(x, (h-1)-y, depth[y][x]));
+	numAvoidedRenders++;
+	return unprojectedCoordinatesOf(windowPoint, side + 2).front();
 }
 
 Vec2i Offset::projectedCoordinatesOf( Vec3d point, int pathID )
 {
-	// Restore the camera according to the direction
-	activeViewer->objectTransformation = objectTransformation[pathID];
+	return projectedCoordinatesOf(std::vector<Vec3d>(1, point), pathID).front();
+}
 
-	// Make sure to call /updateGL() to update the projectionMatrix!!!
-	activeViewer->updateGL();
+std::vector<Vec3d> Offset::unprojectedCoordinatesOf( const std::vector<Vec3d>& windowPoints, int pathID )
+{
+	CameraMatrices cm = cameraMatrices[pathID];
 
-	// \p is expressed in the Qt coordinates, (0, 0) being at the top left conner
-	Vec p = activeViewer->camera()->projectedCoordinatesOf( Vec (point[0], point[1], point[2]) );
+	int N = windowPoints.size();
+	std::vector<Vec3d> points(N);
+
+	#pragma omp parallel for if(N > 1024)
+	for (int i = 0; i < N; i++)
+	{
+		const Vec3d &p = windowPoints[i];
+		points[i] = cm.unproject(p[0], p[1], p[2]);
+	}
+
+	return points;
+}
+
+std::vector<Vec2i> Offset::projectedCoordinatesOf( const std::vector<Vec3d>& points, int pathID )
+{
+	CameraMatrices cm = cameraMatrices[pathID];
 
+	// \p is expressed in the Qt coordinates, (0, 0) being at the top left conner
 	// Convert to OpenGL coordinates
-	int h = activeViewer->height();
-	return Vec2i(p[0], (h-1)-p[1]);
+	int N = points.size();
+	std::vector<Vec2i> pixels(N);
+	numAvoidedRenders += N;
+	for (int i = 0; i < N; i++)
+	{
+		Vec3d p = cm.project(points[i]);
+		pixels[i] = Vec2i(p[0], (cm.height-1)-p[1]);
+	}
+
+	return pixels;
 }
 
 Controller* Offset::ctrl()
@@ -733,6 +864,407 @@ QVector<Vec3d> Offset::getDirectionsInCone( double cone_size )
 }
 
 
+// == Symmetry
+// Only vertical mirror planes through the shape center whose normal is a multiple of 45 degrees
+// are used: they leave both the offset function and the extents volume of computeShapeExtents() unchanged
+QVector<Plane> Offset::detectSymmetryPlanes()
+{
+	QVector<Plane> planes;
+	if (!ctrl()) return planes;
+
+	// Candidates from the symmetry groups and the self symmetries of primitives
+	QVector<Vec3d> normals;
+	foreach(Group* group, ctrl()->groups)
+	{
+		if (group->type == SYMMETRY)
+			normals.push_back(((SymmetryGroup*)group)->symmetryPlane.n);
+	}
+
+	foreach(Primitive* prim, ctrl()->getPrimitives())
+	{
+		foreach(Plane p, prim->symmPlanes)
+			normals.push_back(p.n);
+	}
+
+	// Distinct snapped normals, each verified once
+	QVector<Vec3d> candidates;
+	foreach(Vec3d n, normals)
+	{
+		if (n.norm() < ZERO_TOLERANCE) continue;
+		n.normalize();
+
+		// Mirror planes must be vertical
+		if (fabs(n.z()) > ZERO_TOLERANCE) continue;
+
+		// Snap the azimuth to a multiple of 45 degrees
+		double azimuth = atan2(n.y(), n.x());
+		double snapped = floor(azimuth / (M_PI / 4) + 0.5) * (M_PI / 4);
+		if (fabs(azimuth - snapped) > 0.01) continue;
+		n = Vec3d(cos(snapped), sin(snapped), 0);
+
+		// n and -n are the same mirror
+		bool isKnown = false;
+		foreach(Vec3d m, candidates)
+			if (fabs(dot(m, n)) > 1 - ZERO_TOLERANCE) isKnown = true;
+		if (!isKnown) candidates.push_back(n);
+	}
+
+	if (candidates.isEmpty()) return planes;
+
+	// All vertices, with the segment they belong to, shared by the verifications
+	std::vector<QSurfaceMesh*> segments = activeObject()->getSegments();
+	KDTree tree;
+	std::vector< std::pair<int, int> > owner;
+
+	for (int s = 0; s < (int)segments.size(); s++)
+	{
+		Surface_mesh::Vertex_property<Point> points = segments[s]->vertex_property<Point>("v:point");
+		Surface_mesh::Vertex_iterator vit, vend = segments[s]->vertices_end();
+
+		for (vit = segments[s]->vertices_begin(); vit != vend; ++vit)
+		{
+			tree.insert(&points[vit][0], owner.size());
+			owner.push_back(std::make_pair(s, Surface_mesh::Vertex(vit).idx()));
+		}
+	}
+
+	// Verify on the geometry
+	foreach(Vec3d n, candidates)
+	{
+		Plane plane(n, activeObject()->center);
+		if (isSymmetryOf(plane, tree, owner)) planes.push_back(plane);
+	}
+
+	return planes;
+}
+
+bool Offset::isSymmetryOf( const Plane& plane, KDTree & tree, const std::vector< std::pair<int, int> > & owner )
+{
+	// Every mirrored vertex sample should land on the surface
+	double tolerance = 0.01 * activeObject()->radius;
+	Vec3d c = plane.center, n = plane.n;
+
+	std::vector<QSurfaceMesh*> segments = activeObject()->getSegments();
+
+	if (owner.empty()) return false;
+
+	int stride = Max(1, (int)owner.size() / SYMMETRY_SAMPLES);
+
+	for (int i = 0; i < (int)owner.size(); i += stride)
+	{
+		QSurfaceMesh * seg = segments[owner[i].first];
+		Point p = seg->vertex_property<Point>("v:point")[Surface_mesh::Vertex(owner[i].second)];
+		Vec3d q = p - 2 * dot(p - c, n) * n;
+
+		kdres * found = tree.nearest(&q[0]);
+		if (!found) return false;
+		int j = found->riter->item->index;
+		kd_res_free(found);
+
+		// Closest point on the faces around the nearest vertex
+		QSurfaceMesh * other = segments[owner[j].first];
+		Surface_mesh::Vertex v(owner[j].second);
+		double dist = (other->vertex_property<Point>("v:point")[v] - q).norm();
+
+		if (!other->is_isolated(v))
+		{
+			Surface_mesh::Face_around_vertex_circulator fit, fend;
+			fit = fend = other->faces(v);
+
+			do{
+				dist = Min(dist, (other->closestPointFace(fit, q) - q).norm());
+			} while (++fit != fend);
+		}
+
+		if (dist > tolerance) return false;
+	}
+
+	return true;
+}
+
+QVector<int> Offset::symmetryRepresentatives( const QVector<Vec3d>& directions, const QVector<Plane>& planes )
+{
+	// The i-th direction is evaluated through representative[i]
+	int N = directions.size();
+	QVector<int> representative(N, -1);
+
+	for (int i = 0; i < N; i++)
+	{
+		if (representative[i] != -1) continue;
+		representative[i] = i;
+
+		// Orbit of the direction under the group generated by the mirrors
+		QVector<Vec3d> orbit;
+		orbit.push_back(directions[i]);
+
+		for (int k = 0; k < orbit.size(); k++)
+		{
+			foreach(Plane p, planes)
+			{
+				Vec3d d = orbit[k] - 2 * dot(orbit[k], p.n) * p.n;
+
+				bool isKnown = false;
+				foreach(Vec3d o, orbit)
+					if ((o - d).norm() < ZERO_TOLERANCE) isKnown = true;
+				if (isKnown) continue;
+
+				orbit.push_back(d);
+
+				// Sampled directions that are images share the representative
+				for (int j = i + 1; j < N; j++)
+				{
+					if (representative[j] == -1 && (directions[j] - d).norm() < ZERO_TOLERANCE)
+						representative[j] = i;
+				}
+			}
+		}
+	}
+
+	return representative;
+}
+
+
+// == Radial profiles
+// All parts are GCs with two symmetry planes (rings) whose cross sections are
+// centered on the vertical line through the shape center
+bool Offset::isRotationallySymmetric()
+{
+	if (!ctrl() || ctrl()->getPrimitives().isEmpty()) return false;
+
+	Point c = activeObject()->center;
+	double tolerance = 0.01 * activeObject()->radius;
+
+	foreach(Primitive* prim, ctrl()->getPrimitives())
+	{
+		if (prim->primType != GCYLINDER || prim->symmPlanes.size() != 2) 
+			return false;
+
+		foreach(Point p, prim->points())
+		{
+			if (fabs(p.x() - c.x()) > tolerance || fabs(p.y() - c.y()) > tolerance)
+				return false;
+		}
+
+		foreach(Vec3d axis, prim->majorAxis())
+		{
+			if (fabs(axis.normalized().z()) < 1 - ZERO_TOLERANCE)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void Offset::computeRadialProfiles()
+{
+	Point c = activeObject()->center;
+
+	// Same resolution as the rendered envelopes
+	int N = Max(16, activeViewer->width() / 2);
+	profileBinWidth = activeObject()->radius / (N - 1);
+
+	upperProfile.assign(N, -BIG_NUMBER);
+	lowerProfile.assign(N, BIG_NUMBER);
+
+	// Sample the faces in (radius, height) with steps shorter than a bin; a face can
+	// pass closer to the axis than any of its edges, e.g. a cap spanning the axis
+	foreach(QSurfaceMesh* mesh, activeObject()->getSegments())
+	{
+		Surface_mesh::Vertex_property<Point> points = mesh->vertex_property<Point>("v:point");
+		Surface_mesh::Face_iterator fit, fend = mesh->faces_end();
+
+		for (fit = mesh->faces_begin(); fit != fend; ++fit)
+		{
+			std::vector<Point> face;
+			Surface_mesh::Vertex_around_face_circulator fvit = mesh->vertices(fit), fvend = fvit;
+			do{
+				face.push_back(points[fvit]);
+			} while (++fvit != fvend);
+
+			// Fan triangulation
+			for (int t = 1; t + 1 < (int)face.size(); t++)
+			{
+				Point p0 = face[0], p1 = face[t], p2 = face[t+1];
+
+				double longest = Max((p1 - p0).norm(), Max((p2 - p1).norm(), (p0 - p2).norm()));
+				int steps = 1 + (int)(longest / (0.5 * profileBinWidth));
+
+				for (int i = 0; i <= steps; i++)
+				{
+					for (int j = 0; i + j <= steps; j++)
+					{
+						Point p = p0 + (p1 - p0) * (double(i) / steps) + (p2 - p0) * (double(j) / steps);
+						double r = sqrt(pow(p.x() - c.x(), 2) + pow(p.y() - c.y(), 2));
+						int bin = Min(N - 1, (int)(r / profileBinWidth + 0.5));
+
+						upperProfile[bin] = Max(upperProfile[bin], p.z());
+						lowerProfile[bin] = Min(lowerProfile[bin], p.z());
+					}
+				}
+			}
+		}
+	}
+}
+
+double Offset::computeRadialOffset()
+{
+	computeRadialProfiles();
+
+	// Same convention as \computeOffset: zero where either envelope is missing
+	double om = 0;
+	for (int i = 0; i < (int)upperProfile.size(); i++)
+	{
+		if (upperProfile[i] == -BIG_NUMBER || lowerProfile[i] == BIG_NUMBER) continue;
+
+		om = Max(om, upperProfile[i] - lowerProfile[i]);
+	}
+
+	return om;
+}
+
+
+// == Proxy
+// Height fields of the proxy triangles, rasterized on the CPU in the frame where \direction is z
+double Offset::computeProxyOffset( Vec3d direction, Vec3d &extent )
+{
+	Quaternion q(Vec(direction), Vec(0, 0 ,1));
+
+	// Proxy triangles in the rotated frame
+	std::vector<Point> pnts;
+	foreach(Primitive* prim, ctrl()->getPrimitives())
+	{
+		QSurfaceMesh proxy = prim->getGeometry();
+		Surface_mesh::Vertex_property<Point> points = proxy.vertex_property<Point>("v:point");
+		Surface_mesh::Face_iterator fit, fend = proxy.faces_end();
+
+		for (fit = proxy.faces_begin(); fit != fend; ++fit)
+		{
+			std::vector<Point> face;
+			Surface_mesh::Vertex_around_face_circulator fvit = proxy.vertices(fit), fvend = fvit;
+			do{
+				Vec v = q.rotate(Vec(points[fvit]));
+				face.push_back(Point(v.x, v.y, v.z));
+			} while (++fvit != fvend);
+
+			// Fan triangulation, cage faces may be quads
+			for (int i = 1; i + 1 < (int)face.size(); i++)
+			{
+				pnts.push_back(face[0]);
+				pnts.push_back(face[i]);
+				pnts.push_back(face[i+1]);
+			}
+		}
+	}
+
+	Vec3d bbmin( DBL_MAX,  DBL_MAX,  DBL_MAX);
+	Vec3d bbmax(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+	for (int i = 0; i < (int)pnts.size(); i++)
+	{
+		bbmin.minimize(pnts[i]);
+		bbmax.maximize(pnts[i]);
+	}
+	extent = bbmax - bbmin;
+
+	int G = proxyResolution;
+	double sx = Max(extent.x(), 1e-10) / G;
+	double sy = Max(extent.y(), 1e-10) / G;
+
+	Buffer2d upper(G, std::vector<double>(G, -BIG_NUMBER));
+	Buffer2d lower(G, std::vector<double>(G, BIG_NUMBER));
+
+	for (int t = 0; t + 2 < (int)pnts.size(); t += 3)
+	{
+		Point a = pnts[t], b = pnts[t+1], c = pnts[t+2];
+
+		// Corners always count, so that faces seen edge-on are not lost
+		for (int k = 0; k < 3; k++)
+		{
+			Point p = pnts[t+k];
+			int x = RANGED(0, (int)((p.x() - bbmin.x()) / sx), G-1);
+			int y = RANGED(0, (int)((p.y() - bbmin.y()) / sy), G-1);
+			upper[y][x] = Max(upper[y][x], p.z());
+			lower[y][x] = Min(lower[y][x], p.z());
+		}
+
+		double area = (b.x() - a.x()) * (c.y() - a.y()) - (c.x() - a.x()) * (b.y() - a.y());
+		if (fabs(area) < 1e-12) continue;
+
+		int xmin = Max(0, (int)((Min(a.x(), Min(b.x(), c.x())) - bbmin.x()) / sx));
+		int xmax = Min(G-1, (int)((Max(a.x(), Max(b.x(), c.x())) - bbmin.x()) / sx));
+		int ymin = Max(0, (int)((Min(a.y(), Min(b.y(), c.y())) - bbmin.y()) / sy));
+		int ymax = Min(G-1, (int)((Max(a.y(), Max(b.y(), c.y())) - bbmin.y()) / sy));
+
+		// Cell centers inside the triangle take its interpolated height
+		for (int y = ymin; y <= ymax; y++)
+		{
+			double py = bbmin.y() + (y + 0.5) * sy;
+			for (int x = xmin; x <= xmax; x++)
+			{
+				double px = bbmin.x() + (x + 0.5) * sx;
+
+				double wa = ((b.x() - px) * (c.y() - py) - (c.x() - px) * (b.y() - py)) / area;
+				double wb = ((c.x() - px) * (a.y() - py) - (a.x() - px) * (c.y() - py)) / area;
+				double wc = 1.0 - wa - wb;
+				if (wa < 0 || wb < 0 || wc < 0) continue;
+
+				double z = wa * a.z() + wb * b.z() + wc * c.z();
+				upper[y][x] = Max(upper[y][x], z);
+				lower[y][x] = Min(lower[y][x], z);
+			}
+		}
+	}
+
+	// Same convention as \computeOffset: zero where the proxies are missing
+	double om = 0;
+	for (int y = 0; y < G; y++){
+		for (int x = 0; x < G; x++)
+		{
+			if (upper[y][x] == -BIG_NUMBER) continue;
+			om = Max(om, upper[y][x] - lower[y][x]);
+		}
+	}
+
+	return om;
+}
+
+double Offset::computeProxyStackability( Vec3d direction )
+{
+	if (!activeObject() || !ctrl()) return -1;
+
+	// The \V0 of proxies
+	Vec3d diag;
+	computeProxyOffset(Vec3d(0, 0, 1), diag);
+	double V0 = volumeOfBB(diag);
+
+	Vec3d extent;
+	double om = computeProxyOffset(direction, extent);
+	double V1 = volumeOfBB(extent);
+
+	return 1.0 - (om / extent[2]) * (V1 / V0);
+}
+
+double Offset::computeProxyStackability()
+{
+	if (!activeObject() || !ctrl()) return -1;
+
+	Vec3d diag;
+	computeProxyOffset(Vec3d(0, 0, 1), diag);
+	double V0 = volumeOfBB(diag);
+
+	double maxStackability = -1;
+	foreach(Vec3d vec, getDirectionsInCone(coneSize))
+	{
+		Vec3d extent;
+		double om = computeProxyOffset(vec, extent);
+		double V1 = volumeOfBB(extent);
+
+		maxStackability = Max(maxStackability, 1.0 - (om / extent[2]) * (V1 / V0));
+	}
+
+	return maxStackability;
+}
+
+
 Vec3d Offset::computeShapeExtents( Vec3d direction )
 {
 	// Rotate the shape so that \up becomes z axis
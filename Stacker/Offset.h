@@ -9,10 +9,12 @@
 #include "HotSpot.h"
 #include "Numeric.h"
 #include "HiddenViewer.h"
+#include "GraphicsLibrary/Basic/Plane.h"
 
 #define ZERO_TOLERANCE 0.001
 
 class HiddenViewer;
+class KDTree;
 
 enum SEARCH_TYPE
 {
@@ -40,6 +42,7 @@ public:
 	void computeOffset();
 	void computeOffsetOfRegion( Vec3d direction, std::vector< Vec2i >& region );
 	void computeOffsetOfShape( Vec3d direction );
+	double maxOffset();
 
 	// Hot spots
 	void		detectHotspots();
@@ -53,6 +56,21 @@ public:
 	QVector<Vec3d> getDirectionsOnXYPlane();
 	QVector<Vec3d> getDirectionsInCone(double cone_size);
 
+	// Symmetry of the stacking direction search
+	QVector<Plane> detectSymmetryPlanes();
+	bool isSymmetryOf(const Plane& plane, KDTree & tree, const std::vector< std::pair<int, int> > & owner);
+	QVector<int> symmetryRepresentatives(const QVector<Vec3d>& directions, const QVector<Plane>& planes);
+
+	// Radial profiles of shapes of revolution around the vertical axis
+	bool	isRotationallySymmetric();
+	void	computeRadialProfiles();
+	double	computeRadialOffset();
+
+	// Proxy level evaluation from the Cuboid boxes and the GC cages
+	double	computeProxyOffset(Vec3d direction, Vec3d &extent);
+	double	computeProxyStackability(Vec3d direction);
+	double	computeProxyStackability();
+
 	// Shortener
 	QSegMesh*	activeObject();
 	Controller* ctrl();
@@ -61,6 +79,8 @@ public:
 	// Utilities 
 	Vec3d unprojectedCoordinatesOf( uint x, uint y, int direction);
 	Vec2i projectedCoordinatesOf( Vec3d point, int pathID );
+	std::vector<Vec3d> unprojectedCoordinatesOf( const std::vector<Vec3d>& windowPoints, int pathID );
+	std::vector<Vec2i> projectedCoordinatesOf( const std::vector<Vec3d>& points, int pathID );
 	Vec3d computeShapeExtents(Vec3d direction);
 	Vec3d computeCameraUpVector(Vec3d newZ);
 
@@ -69,11 +89,18 @@ public:
 
 	// Stackability
 	double O_max;
+	Vec3d stackingDirection;
 
 	// Parameters
 	SEARCH_TYPE searchType;
 	double coneSize;
 	int searchDensity;			// Number of samples in [0, PI]
+	bool isUsingSymmetry;		// Evaluate one fundamental domain of directions only
+	QVector<Plane> symmetryPlanes;
+	int numDirectionsEvaluated;
+	bool isUsingRadialProfile;	// Skip rendering along the axis of shapes of revolution
+	int proxyResolution;		// Grid size of the proxy height fields
+	bool isSubPixelMax;			// Refine O_max by quadratic fits at the top offset maxima
 
 	// Buffers
 	Buffer2d upperEnvelope;
@@ -82,6 +109,16 @@ public:
 	Buffer2d lowerDepth;
 	Buffer2d offset; 	
 
+	// Min/max pyramids of the buffers above, rebuilt with each render
+	MinMaxPyramid upperPyramid;
+	MinMaxPyramid lowerPyramid;
+	MinMaxPyramid offsetPyramid;
+
+	// Radial profiles, indexed by the distance to the axis
+	std::vector<double> upperProfile;
+	std::vector<double> lowerProfile;
+	double profileBinWidth;
+
 	// Hot stuff
 	std::map< QString, std::vector<Vec3d> > hotPoints;
 	Buffer2v2i hotRegions;
@@ -92,6 +129,8 @@ public:
 
 	// Camera setting
 	QMap<int, ObjectTranformation> objectTransformation;
+	QMap<int, CameraMatrices> cameraMatrices;	// Captured with each envelope
+	int numAvoidedRenders;						// Calls to updateGL() saved by \cameraMatrices in the last \detectHotspots
 
 public slots:
 	void setSearchType(int type);
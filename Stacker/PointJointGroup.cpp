@@ -55,12 +55,12 @@ void PointJointGroup::draw()
 
 }
 
-void PointJointGroup::saveParameters( std::ofstream &outF )
+void PointJointGroup::saveParameters( std::ostream &outF )
 {
 	outF << getJointPos();
 }
 
-void PointJointGroup::loadParameters( std::ifstream &inF, Vec3d translation, double scaleFactor )
+void PointJointGroup::loadParameters( std::istream &inF, Vec3d translation, double scaleFactor )
 {
 	inF >> pos;
 	pos += translation;
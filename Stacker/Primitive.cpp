@@ -9,6 +9,9 @@ Primitive::Primitive( QSurfaceMesh* mesh, QString newId )
 
 	isSelected = false;
 	isFrozen = false;
+	isDirty = false;
+	isDeferred = false;
+	numDeformations = 0;
 
 	isDraw = true;
 
@@ -77,6 +80,14 @@ Vec3d Primitive::centerPoint()
 	return centerPoint /= pnts.size();
 }
 
+void Primitive::requestDeformation()
+{
+	if (isDeferred)
+		isDirty = true;
+	else
+		deformMesh();
+}
+
 void Primitive::addFixedPoint( Point fp )
 {
 	fixedPoints.push_back(fp);
@@ -86,19 +97,22 @@ double Primitive::similarity( void* state1, void* state2 )
 {
 	// Save the current state
 	void* state = getState();
+	bool wasDirty = isDirty;
 	
+	// Only the primitive points are compared, the mesh is left alone
 	std::vector<Vec3d> points1, points2;
-	setState(state1);
+	applyState(state1);
 	points1 = points();
-	setState(state2);
+	applyState(state2);
 	points2 = points();
 
 	double result = 0;
 	for (int i=0; i<points1.size();i++)
 		result += (points1[i] - points2[i]).norm();
 	
-	// Restore the current state
-	setState(state);
+	// Restore the current state, which the mesh still matches
+	applyState(state);
+	isDirty = wasDirty;
 
 	return result;
 }
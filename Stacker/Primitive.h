@@ -20,8 +20,16 @@ public:
 	virtual void fit() = 0;
 	virtual void computeMeshCoordinates() = 0;
 
+	// Mesh coordinates packed as doubles, so they can be stored instead of recomputed
+	virtual std::vector<double> packedMeshCoordinates() { return std::vector<double>(); }
+	std::vector<double> cachedCoordinates;	// Taken by the next \computeMeshCoordinates if they fit
+
 	// Deform the underlying geometry according to the \pre_state and current state
 	virtual void deformMesh() = 0;
+	bool isDirty;					// Parameters changed since the last \deformMesh
+	bool isDeferred;				// Edits only mark the mesh dirty
+	int  numDeformations;			// Calls to \deformMesh, for profiling
+	void requestDeformation();		// Deform now or later, depending on \isDeferred
 
 	// Visualize the primitive and potential actions
 	virtual void draw() = 0;
@@ -47,6 +55,7 @@ public:
 	// Primitive state
 	virtual void*	getState() = 0;
 	virtual void	setState( void* state) = 0;
+	virtual void	applyState( void* state) = 0;	// Same as \setState but leaves the mesh dirty
 
 	// Primitive geometry
 	double	originalVolume;
@@ -90,8 +99,8 @@ public:
 	virtual Point	getSelectedCurveCenter() = 0;
 
 	// Save and load
-	virtual void save(std::ofstream &outF) = 0;
-	virtual void load(std::ifstream &inF, Vec3d translation, double scaleFactor) = 0;
+	virtual void save(std::ostream &outF) = 0;
+	virtual void load(std::istream &inF, Vec3d translation, double scaleFactor) = 0;
 	virtual void	serialize( QTextStream &out) = 0;
 	virtual void	unserialize( QTextStream &in) = 0;
 
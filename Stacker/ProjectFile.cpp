@@ -0,0 +1,449 @@
+#include "ProjectFile.h"
+
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <QFileInfo>
+#include <QVector>
+
+#include "Controller.h"
+#include "GraphicsLibrary/Mesh/QSegMesh.h"
+
+// Section tags
+#define PROJECT_MESH		"MESH"	// Segments: name, points and triangles
+#define PROJECT_CONTROLLER	"CTRL"	// Controller::save records
+#define PROJECT_GROUPS		"GRPS"	// Controller::saveGroups records
+#define PROJECT_COORDINATES	"COOR"	// Packed mesh coordinates of each primitive
+
+struct ProjectHeader{ char magic[8]; quint32 version, numSections; };
+struct ProjectSection{ char tag[4]; quint32 reserved; quint64 offset, size; };
+
+// Records inside the sections, each followed by its 8-byte padded arrays
+struct CountRecord{ quint32 count, reserved; };
+struct SegmentRecord{ quint32 nameSize, numVertices, numFaces, reserved; };
+struct CoordinateRecord{ quint32 idSize, reserved; quint64 count; };
+
+static void appendPadded( QByteArray & bytes, const char * from, qint64 n )
+{
+	if(n > 0) bytes.append(from, n);
+	while(bytes.size() % 8) bytes.append('\0');
+}
+
+template< typename T >
+static void appendRecord( QByteArray & bytes, const T & record )
+{
+	appendPadded(bytes, (const char *) &record, sizeof(T));
+}
+
+// Walks a mapped section, failing once anything would run past its end
+struct SectionReader
+{
+	const uchar * p, * end;
+	bool ok;
+
+	SectionReader(const uchar * begin, qint64 bytes) : p(begin), end(begin + bytes), ok(true) {}
+
+	const uchar * take(quint64 n)
+	{
+		quint64 padded = (n + 7) & ~quint64(7);
+		if(!ok || quint64(end - p) < padded) { ok = false; return NULL; }
+		const uchar * at = p;
+		p += padded;
+		return at;
+	}
+
+	template< typename T >
+	bool read(T & record)
+	{
+		const uchar * at = take(sizeof(T));
+		if(at) memcpy(&record, at, sizeof(T));
+		return at != NULL;
+	}
+};
+
+ProjectFile::ProjectFile()
+{
+	file = NULL;
+	data = NULL;
+	size = 0;
+}
+
+ProjectFile::~ProjectFile()
+{
+	close();
+}
+
+bool ProjectFile::open( QString fileName )
+{
+	close();
+
+	file = new QFile(fileName);
+	if(!file->open(QIODevice::ReadOnly) || file->size() < (qint64)sizeof(ProjectHeader))
+	{
+		close();
+		return false;
+	}
+
+	size = file->size();
+	data = file->map(0, size);
+	if(!data)
+	{
+		close();
+		return false;
+	}
+
+	ProjectHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	qint64 tableEnd = sizeof(ProjectHeader) + qint64(header.numSections) * sizeof(ProjectSection);
+
+	if(strncmp(header.magic, PROJECT_MAGIC, 8) != 0 || header.version > PROJECT_VERSION || tableEnd > size)
+	{
+		close();
+		return false;
+	}
+
+	// Unknown sections are skipped, so older readers still load newer files
+	for(uint i = 0; i < header.numSections; i++)
+	{
+		ProjectSection entry;
+		memcpy(&entry, data + sizeof(ProjectHeader) + i * sizeof(ProjectSection), sizeof(entry));
+
+		if(entry.offset + entry.size > quint64(size))
+		{
+			close();
+			return false;
+		}
+
+		Section s;
+		s.offset = entry.offset;
+		s.size = entry.size;
+		sections[QString::fromAscii(entry.tag, 4)] = s;
+	}
+
+	return true;
+}
+
+void ProjectFile::close()
+{
+	if(file)
+	{
+		if(data) file->unmap(data);
+		file->close();
+		delete file;
+	}
+
+	file = NULL;
+	data = NULL;
+	size = 0;
+	sections.clear();
+}
+
+bool ProjectFile::section( QString tag, const uchar *& begin, qint64 & bytes )
+{
+	if(!data || !sections.contains(tag)) return false;
+
+	begin = data + sections[tag].offset;
+	bytes = sections[tag].size;
+	return true;
+}
+
+bool ProjectFile::readMesh( QSegMesh * mesh )
+{
+	const uchar * begin;
+	qint64 bytes;
+	if(!section(PROJECT_MESH, begin, bytes)) return false;
+
+	SectionReader in(begin, bytes);
+
+	CountRecord numSegments;
+	if(!in.read(numSegments)) return false;
+
+	mesh->segmentName.clear();
+
+	for(uint i = 0; i < numSegments.count; i++)
+	{
+		SegmentRecord r;
+		if(!in.read(r)) return false;
+
+		const char * name = (const char *) in.take(r.nameSize);
+		const double * points = (const double *) in.take(quint64(r.numVertices) * 3 * sizeof(double));
+		const quint32 * faces = (const quint32 *) in.take(quint64(r.numFaces) * 3 * sizeof(quint32));
+		if(!in.ok) return false;
+
+		if(r.numVertices == 0) continue;
+
+		QSurfaceMesh * seg = new QSurfaceMesh();
+		seg->reserve(r.numVertices, 3 * r.numFaces / 2, r.numFaces);
+
+		for(uint v = 0; v < r.numVertices; v++)
+			seg->add_vertex(Point(points[3*v + 0], points[3*v + 1], points[3*v + 2]));
+
+		for(uint f = 0; f < r.numFaces; f++)
+		{
+			const quint32 * t = faces + 3*f;
+			if(t[0] >= r.numVertices || t[1] >= r.numVertices || t[2] >= r.numVertices) continue;
+
+			seg->add_triangle(Surface_mesh::Vertex(t[0]), Surface_mesh::Vertex(t[1]), Surface_mesh::Vertex(t[2]));
+		}
+
+		mesh->segmentName.push_back(QString::fromUtf8(name, r.nameSize));
+		mesh->insertMesh(seg);
+	}
+
+	mesh->build_up();
+
+	return true;
+}
+
+Controller * ProjectFile::readController( QSegMesh * mesh )
+{
+	const uchar * begin;
+	qint64 bytes;
+	if(!section(PROJECT_CONTROLLER, begin, bytes)) return NULL;
+
+	std::istringstream ctrlIn(std::string((const char *) begin, strnlen((const char *) begin, bytes)));
+
+	// Stored mesh coordinates, by primitive
+	QMap<QString, std::vector<double> > coords;
+
+	if(section(PROJECT_COORDINATES, begin, bytes))
+	{
+		SectionReader in(begin, bytes);
+
+		CountRecord numPrimitives;
+		in.read(numPrimitives);
+
+		for(uint i = 0; in.ok && i < numPrimitives.count; i++)
+		{
+			CoordinateRecord r;
+			if(!in.read(r)) break;
+
+			const char * id = (const char *) in.take(r.idSize);
+			const double * values = (const double *) in.take(r.count * sizeof(double));
+			if(!in.ok) break;
+
+			coords[QString::fromUtf8(id, r.idSize)] = std::vector<double>(values, values + r.count);
+		}
+	}
+
+	Controller * ctrl = new Controller(mesh, ctrlIn, coords);
+
+	if(section(PROJECT_GROUPS, begin, bytes))
+	{
+		std::istringstream groupsIn(std::string((const char *) begin, strnlen((const char *) begin, bytes)));
+		ctrl->loadGroups(groupsIn);
+	}
+
+	return ctrl;
+}
+
+bool ProjectFile::save( QString fileName, QSegMesh * mesh, Controller * ctrl, bool withCoordinates )
+{
+	QVector<QString> tags;
+	QVector<QByteArray> contents;
+
+	// Mesh
+	{
+		QByteArray bytes;
+
+		CountRecord numSegments = { (quint32) mesh->nbSegments(), 0 };
+		appendRecord(bytes, numSegments);
+
+		for(uint i = 0; i < mesh->nbSegments(); i++)
+		{
+			QSurfaceMesh * seg = mesh->getSegment(i);
+			QByteArray name = seg->objectName().toUtf8();
+			std::vector<Point> points = seg->clonePoints();
+			std::vector<uint> faces = seg->cloneTriangleIndices();
+
+			std::vector<double> xyz(3 * points.size());
+			for(uint v = 0; v < points.size(); v++)
+			{
+				xyz[3*v + 0] = points[v][0];
+				xyz[3*v + 1] = points[v][1];
+				xyz[3*v + 2] = points[v][2];
+			}
+
+			std::vector<quint32> triangles(faces.begin(), faces.end());
+
+			SegmentRecord r = { (quint32) name.size(), (quint32) points.size(), (quint32) faces.size() / 3, 0 };
+			appendRecord(bytes, r);
+			appendPadded(bytes, name.constData(), name.size());
+			appendPadded(bytes, xyz.empty() ? NULL : (const char *) &xyz[0], xyz.size() * sizeof(double));
+			appendPadded(bytes, triangles.empty() ? NULL : (const char *) &triangles[0], triangles.size() * sizeof(quint32));
+		}
+
+		tags.push_back(PROJECT_MESH);
+		contents.push_back(bytes);
+	}
+
+	if(ctrl)
+	{
+		// Controller and groups keep their text records, at full precision
+		std::ostringstream ctrlOut, groupsOut;
+		ctrlOut.precision(17);
+		groupsOut.precision(17);
+
+		ctrl->save(ctrlOut);
+		ctrl->saveGroups(groupsOut);
+
+		std::string ctrlText = ctrlOut.str(), groupsText = groupsOut.str();
+
+		QByteArray ctrlBytes, groupsBytes;
+		appendPadded(ctrlBytes, ctrlText.c_str(), ctrlText.size());
+		appendPadded(groupsBytes, groupsText.c_str(), groupsText.size());
+
+		tags.push_back(PROJECT_CONTROLLER);
+		contents.push_back(ctrlBytes);
+		tags.push_back(PROJECT_GROUPS);
+		contents.push_back(groupsBytes);
+
+		if(withCoordinates)
+		{
+			QMap<QString, std::vector<double> > coords = ctrl->packedMeshCoordinates();
+
+			QByteArray bytes;
+
+			CountRecord numPrimitives = { (quint32) coords.size(), 0 };
+			appendRecord(bytes, numPrimitives);
+
+			foreach(QString primId, coords.keys())
+			{
+				const std::vector<double> & values = coords[primId];
+				QByteArray id = primId.toUtf8();
+
+				CoordinateRecord r = { (quint32) id.size(), 0, (quint64) values.size() };
+				appendRecord(bytes, r);
+				appendPadded(bytes, id.constData(), id.size());
+				appendPadded(bytes, values.empty() ? NULL : (const char *) &values[0], values.size() * sizeof(double));
+			}
+
+			tags.push_back(PROJECT_COORDINATES);
+			contents.push_back(bytes);
+		}
+	}
+
+	// Header and section table, then the sections
+	ProjectHeader header;
+	memset(&header, 0, sizeof(header));
+	strncpy(header.magic, PROJECT_MAGIC, 8);
+	header.version = PROJECT_VERSION;
+	header.numSections = tags.size();
+
+	QByteArray head;
+	appendRecord(head, header);
+
+	quint64 offset = sizeof(ProjectHeader) + tags.size() * sizeof(ProjectSection);
+
+	for(int i = 0; i < tags.size(); i++)
+	{
+		ProjectSection entry;
+		memcpy(entry.tag, qPrintable(tags[i]), 4);
+		entry.reserved = 0;
+		entry.offset = offset;
+		entry.size = contents[i].size();
+		appendRecord(head, entry);
+
+		offset += contents[i].size();
+	}
+
+	QFile outFile(fileName);
+	if(!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+	bool isWritten = (outFile.write(head.constData(), head.size()) == head.size());
+	for(int i = 0; i < contents.size() && isWritten; i++)
+		isWritten = (outFile.write(contents[i].constData(), contents[i].size()) == contents[i].size());
+
+	outFile.close();
+
+	return isWritten;
+}
+
+bool ProjectFile::fromText( QString objFileName, QString projectFileName )
+{
+	if(!QFileInfo(objFileName).exists()) return false;
+
+	// Same as importing the mesh, with the .seg file
+	QSegMesh mesh;
+	mesh.read(objFileName);
+	mesh.setObjectName(QFileInfo(objFileName).baseName());
+
+	QString baseName = objFileName;
+	baseName.chop(3);
+
+	// Controller and groups with the same file name, fitted when missing
+	Controller * ctrl;
+
+	if(QFileInfo(baseName + "ctrl").exists())
+	{
+		ctrl = new Controller(&mesh, true, baseName + "ctrl");
+
+		if(QFileInfo(baseName + "grp").exists())
+		{
+			std::ifstream inF(qPrintable(baseName + "grp"), std::ios::in);
+			ctrl->loadGroups(inF);
+			inF.close();
+		}
+	}
+	else
+	{
+		ctrl = new Controller(&mesh);
+	}
+
+	bool isSaved = save(projectFileName, &mesh, ctrl);
+
+	delete ctrl;
+
+	return isSaved;
+}
+
+bool ProjectFile::toText( QString projectFileName, QString objFileName )
+{
+	ProjectFile project;
+	if(!project.open(projectFileName)) return false;
+
+	QSegMesh mesh;
+	if(!project.readMesh(&mesh)) return false;
+	mesh.setObjectName(QFileInfo(objFileName).baseName());
+
+	mesh.saveObj(objFileName);
+
+	QString baseName = objFileName;
+	baseName.chop(3);
+
+	// Segmentation, faces numbered as written by saveObj
+	std::ofstream segF(qPrintable(baseName + "seg"), std::ios::out);
+
+	segF << mesh.nbSegments() << "\n" << "labels ";
+	for(uint i = 0; i < mesh.nbSegments(); i++)
+		segF << qPrintable(mesh.getSegment(i)->objectName()) << " ";
+	segF << "\n";
+
+	uint fid = 0;
+	for(uint i = 0; i < mesh.nbSegments(); i++)
+		for(uint j = 0; j < mesh.getSegment(i)->n_faces(); j++)
+			segF << fid++ << " " << i << "\n";
+
+	segF.close();
+
+	// Controller and groups, as stored
+	const uchar * begin;
+	qint64 bytes;
+
+	if(project.section(PROJECT_CONTROLLER, begin, bytes))
+	{
+		std::ofstream ctrlF(qPrintable(baseName + "ctrl"), std::ios::out | std::ios::binary);
+		ctrlF.write((const char *) begin, strnlen((const char *) begin, bytes));
+		ctrlF.close();
+	}
+
+	if(project.section(PROJECT_GROUPS, begin, bytes))
+	{
+		std::ofstream groupsF(qPrintable(baseName + "grp"), std::ios::out | std::ios::binary);
+		groupsF.write((const char *) begin, strnlen((const char *) begin, bytes));
+		groupsF.close();
+	}
+
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QString>
+#include <QMap>
+#include <QFile>
+
+class QSegMesh;
+class Controller;
+
+// Stacker project: a segmented mesh, its controller and groups in one binary file.
+// Native byte order; a header, a table of sections, then the sections, 8-byte aligned.
+// The file is memory mapped on reading and the mesh arrays are read in place.
+#define PROJECT_MAGIC		"STKPROJ"
+#define PROJECT_VERSION		1
+
+class ProjectFile
+{
+public:
+	ProjectFile();
+	~ProjectFile();
+
+	// Map the file and check its header and section table
+	bool open(QString fileName);
+	void close();
+
+	// Segments into an empty \mesh, which is then built up
+	bool readMesh(QSegMesh * mesh);
+
+	// Controller and groups of \mesh, once its segments are named. NULL when there is no controller
+	Controller * readController(QSegMesh * mesh);
+
+	// Mesh and controller, with the mesh coordinates of the primitives so that loading skips them
+	static bool save(QString fileName, QSegMesh * mesh, Controller * ctrl, bool withCoordinates = true);
+
+	// Converters from and to the .obj, .seg, .ctrl and .grp files next to \objFileName
+	static bool fromText(QString objFileName, QString projectFileName);
+	static bool toText(QString projectFileName, QString objFileName);
+
+private:
+	QFile * file;
+	uchar * data;
+	qint64 size;
+
+	struct Section{ qint64 offset, size; };
+	QMap<QString, Section> sections;
+
+	bool section(QString tag, const uchar *& begin, qint64 & bytes);
+};
@@ -19,6 +19,11 @@ Propagator::Propagator( Controller* ctrl )
 {
 	mCtrl = ctrl;
 	mGraph = new ConstraintGraph(mCtrl);
+
+	isUsingPlans = true;
+	isUsingLeastSquares = false;
+
+	numRounds = 0;
 }
 
 void Propagator::regroupPair( QString id1, QString id2, bool sliding /*=false*/ )
@@ -78,28 +83,109 @@ void Propagator::regroupPair( QString id1, QString id2, bool sliding /*=false*/
 }
 
 void Propagator::execute()
+{
+	// The order and the chosen constraints only depend on the graph and
+	// on which primitives are frozen, so a plan recorded once is replayed
+	QString pattern = frozenPattern();
+	if (isUsingPlans && mPlans.contains(pattern))
+	{
+		replay(mPlans[pattern]);
+		return;
+	}
+
+	// Unfrozen parts separated by frozen ones don't affect each other
+	QVector< QVector<int> > components = mGraph->unfrozenComponents();
+	int C = components.size();
+	QVector<Plan> plans(C);
+
+	#pragma omp parallel for schedule(dynamic) if(C > 1)
+	for (int c = 0; c < C; c++)
+		propagateComponent(components[c], plans[c]);
+
+	foreach(const Plan & plan, plans) numRounds += plan.size();
+
+	// Plans are kept in component order, so replaying is deterministic
+	if (isUsingPlans) mPlans[pattern] = plans;
+}
+
+void Propagator::propagateComponent( const QVector<int> & component, Plan & plan )
 {
 	// The next propagation target
-	QString target = mGraph->nextTarget();
+	ConstraintGraph::Frontier frontier(mGraph);
+	frontier.init(component);
+	int target = frontier.next();
 
-	while (!target.isEmpty())
+	while (target >= 0)
 	{
+		plan.push_back(PlanStep(target));
+
 		// Solve the constraints
-		propagateTo(target);
+		propagateTo(target, &plan.last());
 
-		// Freeze the propagated target
-		mGraph->node(target)->isFrozen = true;
+		// Freeze the propagated target, which updates the frontier
+		frontier.freeze(target);
 
 		// The next
-		target = mGraph->nextTarget();
+		target = frontier.next();
 	}
 }
 
+QString Propagator::frozenPattern()
+{
+	QString pattern(mGraph->nodes.size(), '0');
+
+	for (int i = 0; i < mGraph->nodes.size(); i++)
+		if (mGraph->nodes[i]->isFrozen) pattern[i] = '1';
+
+	return pattern;
+}
+
+void Propagator::replay( const QVector<Plan> & plans )
+{
+	int C = plans.size();
+
+	#pragma omp parallel for schedule(dynamic) if(C > 1)
+	for (int c = 0; c < C; c++)
+	{
+		foreach(const PlanStep & step, plans[c])
+		{
+			if (step.isJointSolve)
+				solveJoints(mGraph->nodes[step.target], step.groups);
+			else
+			{
+				foreach(QString groupId, step.groups)
+					mCtrl->groups.value(groupId)->regroup();
+			}
+
+			mGraph->nodes[step.target]->isFrozen = true;
+		}
+	}
+
+	foreach(const Plan & plan, plans) numRounds += plan.size();
+}
+
+void Propagator::regroup( QString groupId, PlanStep * step )
+{
+	// Read-only lookup, components may be propagating concurrently
+	mCtrl->groups.value(groupId)->regroup();
+
+	if (step) step->groups.push_back(groupId);
+}
+
+void Propagator::clearPlans()
+{
+	mPlans.clear();
+}
+
 void Propagator::propagateTo( QString target )
+{
+	propagateTo(mGraph->nodeIndex(target));
+}
+
+void Propagator::propagateTo( int target, PlanStep * step )
 {
 	// All the constrains for the target
 	QVector<ConstraintGraph::Edge> constraints = mGraph->getConstraints(target);
-	int N = constraints.size();
 
 	// This would happen if the graph is not connected
 	// In this case, do nothing
@@ -109,10 +195,10 @@ void Propagator::propagateTo( QString target )
 	// 1. Symmetry (suppose only one)
 	foreach(ConstraintGraph::Edge e, constraints)
 	{
-		Group* group = mCtrl->groups[e.id];
+		Group* group = mCtrl->groups.value(e.id);
 		if ( group->type == SYMMETRY )
 		{
-			group->regroup();
+			regroup(e.id, step);
 			return;
 		}
 	}
@@ -120,28 +206,28 @@ void Propagator::propagateTo( QString target )
 	// 2. Line joint (suppose only one)
 	foreach(ConstraintGraph::Edge e, constraints)
 	{
-		Group* group = mCtrl->groups[e.id];
+		Group* group = mCtrl->groups.value(e.id);
 		if ( group->type == LINEJOINT )
 		{
-			group->regroup();
+			regroup(e.id, step);
 			return;
 		}
 	}
 
 	// 3. Point joint(s)
-	solvePointJointConstraints(target, constraints);
+	solvePointJointConstraints(mGraph->nodes[target]->id, constraints, step);
 }
 
-void Propagator::solvePointJointConstraints( QString target, QVector<ConstraintGraph::Edge> &constraints )
+void Propagator::solvePointJointConstraints( QString target, QVector<ConstraintGraph::Edge> &constraints, PlanStep * step )
 {
-	Primitive* targetPrim = mGraph->node(target);
+	Primitive* targetPrim = mGraph->nodes[mGraph->nodeIndex(target)];
 	int N = constraints.size();
 
 	// If the \target is GC, apply all constraints
 	if (targetPrim->primType == GCYLINDER)
 	{
 		foreach(ConstraintGraph::Edge e, constraints)
-			mCtrl->groups[e.id]->regroup();
+			regroup(e.id, step);
 		return;
 	}
 
@@ -160,17 +246,33 @@ void Propagator::solvePointJointConstraints( QString target, QVector<ConstraintG
 		// Or there are symmetry planes
 		if (N == 1 || !targetPrim->symmPlanes.isEmpty())
 		{
-			mCtrl->groups[constraints.first().id]->regroup();
+			regroup(constraints.first().id, step);
 			return;
 		}
 
 		// == More than one constraint
 		// And no symmetry planes
+		if (isUsingLeastSquares)
+		{
+			QVector<QString> groupIds;
+			foreach(ConstraintGraph::Edge e, constraints)
+				groupIds.push_back(e.id);
+
+			solveJoints(targetPrim, groupIds);
+
+			if (step)
+			{
+				step->groups = groupIds;
+				step->isJointSolve = true;
+			}
+			return;
+		}
+
 		QVector<Point> constraint_points;
 		foreach(ConstraintGraph::Edge e, constraints)
 		{
-			PointJointGroup* group = (PointJointGroup*)mCtrl->groups[e.id];
-			Primitive *frozen = mCtrl->getPrimitive(e.to);
+			PointJointGroup* group = (PointJointGroup*)mCtrl->groups.value(e.id);
+			Primitive *frozen = mGraph->nodes[mGraph->nodeIndex(e.to)];
 			Point p = frozen->fromCoordinate(group->jointCoords[e.to]);
 			constraint_points.push_back(p);
 		}
@@ -191,8 +293,8 @@ void Propagator::solvePointJointConstraints( QString target, QVector<ConstraintG
 				}
 			}
 
-			mCtrl->groups[constraints[idx1].id]->regroup();
-			mCtrl->groups[constraints[idx2].id]->regroup();
+			regroup(constraints[idx1].id, step);
+			regroup(constraints[idx2].id, step);
 		}
 		else
 		{
@@ -210,12 +312,33 @@ void Propagator::solvePointJointConstraints( QString target, QVector<ConstraintG
 				}
 			}
 
-			mCtrl->groups[constraints[idx].id]->regroup();
+			regroup(constraints[idx].id, step);
 		}
 	}
 
 }
 
+void Propagator::solveJoints( Primitive * targetPrim, const QVector<QString> & groupIds )
+{
+	QVector< std::vector<double> > coords;
+	QVector<Point> targets;
+
+	foreach(QString groupId, groupIds)
+	{
+		PointJointGroup* group = (PointJointGroup*)mCtrl->groups.value(groupId);
+		Primitive * frozen = (group->nodes.first() == targetPrim) ? group->nodes.last() : group->nodes.first();
+
+		coords.push_back(group->jointCoords[targetPrim->id]);
+		targets.push_back(frozen->fromCoordinate(group->jointCoords[frozen->id]));
+	}
+
+	((Cuboid*)targetPrim)->fitJoints(coords, targets);
+
+	// Fix the regrouped point joints
+	foreach(Point p, targets)
+		targetPrim->addFixedPoint(p);
+}
+
 void Propagator::slide( QString id )
 {
 	// The main part doesn't slide
@@ -2,6 +2,7 @@
 
 #include <QVector>
 #include <QString>
+#include <QMap>
 
 #include "ShapeState.h"
 #include "ConstraintGraph.h"
@@ -22,10 +23,36 @@ public:
 	// Propagation
 	void execute();
 
-	// Propagate to \target
+	// Propagation plans, recorded per frozen pattern and replayed on later calls
+	struct PlanStep{
+		PlanStep(int t = -1){ target = t; isJointSolve = false; }
+		int target;
+		QVector<QString> groups;	// Regrouped in this order
+		bool isJointSolve;			// \groups are solved together instead
+	};
+	typedef QVector<PlanStep> Plan;
+	bool isUsingPlans;
+	void clearPlans();
+
+	// Solve all point joints of a cuboid at once, instead of the furthest two
+	bool isUsingLeastSquares;
+	void solveJoints( Primitive * targetPrim, const QVector<QString> & groupIds );
+
+	// Statistics
+	int numRounds;		// Propagated (or replayed) targets
+
+	// Propagate to \target, recording the regrouped constraints in \step
 	void propagateTo( QString target );
-	void solvePointJointConstraints( QString target, QVector<ConstraintGraph::Edge> &constraints );
+	void propagateTo( int target, PlanStep * step = NULL );
+	void solvePointJointConstraints( QString target, QVector<ConstraintGraph::Edge> &constraints, PlanStep * step = NULL );
+
 private:
 	Controller *		mCtrl;
 	ConstraintGraph *	mGraph;
+
+	QMap<QString, QVector<Plan> > mPlans;	// One plan per independent component
+	QString frozenPattern();
+	void propagateComponent( const QVector<int> & component, Plan & plan );
+	void replay( const QVector<Plan> & plans );
+	void regroup( QString groupId, PlanStep * step );
 };
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "HiddenViewer.h"
 #include "Controller.h"
 #include "Offset.h"
+#include "Diagnostics.h"
 
 
 StackerPanel::StackerPanel()
@@ -68,6 +69,16 @@ StackerPanel::StackerPanel()
 	connect(panel.hotspotsButton, SIGNAL(clicked()), SLOT(onHotspotsButtonClicked()));
 	connect(panel.outputButton, SIGNAL(clicked()), SLOT(outputForPaper()));
 
+	// Diagnostic images, one check box per channel
+	QGridLayout * debugLayout = (QGridLayout *) panel.debugBox->layout();
+	foreach(QString channel, Diagnostics::channels())
+	{
+		QCheckBox * box = new QCheckBox(channel);
+		debugLayout->addWidget(box, debugLayout->rowCount(), 0, 1, 3);
+		connect(box, SIGNAL(toggled(bool)), SLOT(setDiagnostics()));
+		diagnosticsBoxes[channel] = box;
+	}
+
 	// Default values
 	panel.numExpectedSolutions->setValue(improver->NUM_EXPECTED_SOLUTION);
 	panel.BBTolerance->setValue(improver->BB_TOLERANCE);
@@ -80,6 +91,8 @@ StackerPanel::StackerPanel()
 
 StackerPanel::~StackerPanel()
 {
+	Diagnostics::shutdown();
+
 	delete previewer;
 	delete hiddenViewer;
 	delete activeOffset;
@@ -99,6 +112,12 @@ void StackerPanel::onHotspotsButtonClicked()
 	if(VBO::isVBOSupported()) emit(objectModified()); 
 }
 
+void StackerPanel::setDiagnostics()
+{
+	foreach(QString channel, diagnosticsBoxes.keys())
+		Diagnostics::setEnabled(channel, diagnosticsBoxes[channel]->isChecked());
+}
+
 void StackerPanel::setActiveScene( Scene * newScene )
 {
 	if(activeScene != newScene)	
@@ -144,6 +163,12 @@ void StackerPanel::setActiveObject()
 	// Offset
 	activeOffset->computeStackability();
 
+	// Proxy level estimate, to keep track of its error over the models
+	QString message = QString("Stackability = %1").arg(activeObject()->val["stackability"]);
+	if (ctrl())
+		message += QString(", proxy estimate = %1").arg(activeOffset->computeProxyStackability());
+	showMessage(message);
+
 	// Preview
 	previewer->updateActiveObject();
 
@@ -174,7 +199,9 @@ void StackerPanel::outputForPaper()
 
 	// Compute everything
 	activeOffset->computeStackability();
-	
+
+	// The envelopes of the best direction, which may not have been rendered
+	activeOffset->computeOffsetOfShape(activeOffset->stackingDirection);
 
 	// 1) Save envelopes + offset function (both image + values)
 	double maxUE = getMaxValue(activeOffset->upperEnvelope);
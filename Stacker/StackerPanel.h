@@ -44,6 +44,9 @@ public:
 	Offset			* activeOffset;
 	Improver		* improver;
 
+	// Diagnostic channels
+	QMap<QString, QCheckBox*> diagnosticsBoxes;
+
 public slots:
 	// Scene management
 	void setActiveScene( Scene * newScene);
@@ -61,6 +64,7 @@ public slots:
 	// Debug
 	void onHotspotsButtonClicked();
 	void outputForPaper();
+	void setDiagnostics();
 
 signals:
 	void printMessage( QString );